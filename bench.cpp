@@ -0,0 +1,318 @@
+/*
+  Benchmark of cppunzip with synthetic archives generated in memory.
+  Same archives are generated on every run (fixed seed), so results of different versions can be compared.
+
+  g++ -O2 -std=c++11 -pthread bench.cpp -lz -o bench
+  ./bench          # all
+  ./bench quick    # skip 1M entries archive
+*/
+#include "cppunzip.hpp"
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace cppunzip;
+
+/*
+  Generator of zip archive. Zip64 End of Central Directory Record is written if entry num exceeds 0xffff.
+*/
+struct ZipWriter {
+  std::vector<uint8_t> _buf;
+  std::vector<uint8_t> _cd;
+  uint64_t _entryNum = 0;
+
+  void add(const std::string& name, const std::vector<uint8_t>& content, bool deflate) {
+    using namespace cppunzip::impl;
+
+    std::vector<uint8_t> data = deflate ? Deflate(content) : content;
+    uint16_t method = deflate ? 8 : 0;
+    uint32_t crc = (uint32_t)crc32(0, content.data(), (uInt)content.size());
+    uint64_t offset = _buf.size();
+
+    Write4Byte(_buf, 0x04034b50);
+    Write2Byte(_buf, 20);
+    Write2Byte(_buf, 0); // flags
+    Write2Byte(_buf, method);
+    Write2Byte(_buf, 0); // time
+    Write2Byte(_buf, 0x21); // date
+    Write4Byte(_buf, crc);
+    Write4Byte(_buf, (uint32_t)data.size());
+    Write4Byte(_buf, (uint32_t)content.size());
+    Write2Byte(_buf, (uint16_t)name.size());
+    Write2Byte(_buf, 0);
+    _buf.insert(_buf.end(), name.begin(), name.end());
+    _buf.insert(_buf.end(), data.begin(), data.end());
+
+    Write4Byte(_cd, 0x02014b50);
+    Write2Byte(_cd, 20);
+    Write2Byte(_cd, 20);
+    Write2Byte(_cd, 0);
+    Write2Byte(_cd, method);
+    Write2Byte(_cd, 0);
+    Write2Byte(_cd, 0x21);
+    Write4Byte(_cd, crc);
+    Write4Byte(_cd, (uint32_t)data.size());
+    Write4Byte(_cd, (uint32_t)content.size());
+    Write2Byte(_cd, (uint16_t)name.size());
+    Write2Byte(_cd, 0); // extra
+    Write2Byte(_cd, 0); // comment
+    Write2Byte(_cd, 0); // disk
+    Write2Byte(_cd, 0); // internal attr
+    Write4Byte(_cd, 0); // external attr
+    Write4Byte(_cd, (uint32_t)offset);
+    _cd.insert(_cd.end(), name.begin(), name.end());
+    _entryNum++;
+  }
+
+  std::vector<uint8_t> finish(size_t commentLen = 0) {
+    using namespace cppunzip::impl;
+
+    uint64_t cdOffset = _buf.size();
+    _buf.insert(_buf.end(), _cd.begin(), _cd.end());
+    bool zip64 = _entryNum > 0xffff;
+    if(zip64) {
+      uint64_t zip64Offset = _buf.size();
+      Write4Byte(_buf, 0x06064b50);
+      Write8Byte(_buf, 44);
+      Write2Byte(_buf, 45);
+      Write2Byte(_buf, 45);
+      Write4Byte(_buf, 0);
+      Write4Byte(_buf, 0);
+      Write8Byte(_buf, _entryNum);
+      Write8Byte(_buf, _entryNum);
+      Write8Byte(_buf, _cd.size());
+      Write8Byte(_buf, cdOffset);
+
+      Write4Byte(_buf, 0x07064b50);
+      Write4Byte(_buf, 0);
+      Write8Byte(_buf, zip64Offset);
+      Write4Byte(_buf, 1);
+    }
+    uint16_t entryNum = zip64 ? 0xffff : (uint16_t)_entryNum;
+    Write4Byte(_buf, 0x06054b50);
+    Write2Byte(_buf, 0);
+    Write2Byte(_buf, 0);
+    Write2Byte(_buf, entryNum);
+    Write2Byte(_buf, entryNum);
+    Write4Byte(_buf, (uint32_t)_cd.size());
+    Write4Byte(_buf, (uint32_t)cdOffset);
+    Write2Byte(_buf, (uint16_t)commentLen);
+    _buf.resize(_buf.size()+commentLen, 'c');
+
+    std::vector<uint8_t> res;
+    res.swap(_buf);
+    _cd.clear();
+    _entryNum = 0;
+    return res;
+  }
+
+  static std::vector<uint8_t> Deflate(const std::vector<uint8_t>& src) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if(deflateInit2(&zs, 6, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+      throw UnZipError("deflateInit2 fail.");
+    std::vector<uint8_t> dst(deflateBound(&zs, (uLong)src.size()));
+    zs.next_in = (Bytef*)src.data();
+    zs.avail_in = (uInt)src.size();
+    zs.next_out = dst.data();
+    zs.avail_out = (uInt)dst.size();
+    int res = deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+    if(res != Z_STREAM_END)
+      throw UnZipError("deflate fail.");
+    dst.resize(zs.total_out);
+    return dst;
+  }
+};
+
+// text like data, compressed to about 1/3 by deflate.
+std::vector<uint8_t> makeContent(size_t size, uint32_t seed) {
+  static const char* words[] = { "zip ", "central ", "directory ", "record ", "local ", "header ", "inflate ", "stream ",
+    "entry ", "offset ", "size ", "crc ", "\n", "deflate ", "stored ", "archive " };
+  std::vector<uint8_t> res;
+  res.reserve(size+16);
+  uint32_t x = seed*2654435761u + 1;
+  while(res.size() < size) {
+    x = x*1664525u + 1013904223u;
+    const char* w = words[(x >> 24) & 15];
+    res.insert(res.end(), w, w+strlen(w));
+    if(((x >> 16) & 7) == 0)
+      res.push_back((uint8_t)('0' + ((x >> 8) % 10)));
+  }
+  res.resize(size);
+  return res;
+}
+
+std::string makeName(size_t i) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "dir%03zu/sub%02zu/file%07zu.txt", i % 1000, i % 97, i);
+  return buf;
+}
+
+std::vector<uint8_t> makeArchive(size_t entryNum, size_t contentSize, bool deflate, size_t commentLen = 0) {
+  ZipWriter writer;
+  for(size_t i = 0; i < entryNum; i++)
+    writer.add(makeName(i), makeContent(contentSize, (uint32_t)i), deflate);
+  return writer.finish(commentLen);
+}
+
+typedef std::chrono::steady_clock Clock;
+
+// run func repeat times and return best seconds of one run.
+template<typename F>
+double measure(int repeat, F func) {
+  double best = 1e30;
+  for(int i = 0; i < repeat; i++) {
+    auto begin = Clock::now();
+    func();
+    double sec = std::chrono::duration<double>(Clock::now() - begin).count();
+    best = std::min(best, sec);
+  }
+  return best;
+}
+
+// volatile sink to keep results alive.
+volatile size_t g_sink = 0;
+
+void benchEOCD() {
+  for(size_t commentLen : {0, 60000}) {
+    std::vector<uint8_t> zip = makeArchive(10, 100, false, commentLen);
+    MemoryFile f(zip.data(), zip.size());
+    const int loop = 10000;
+    double sec = measure(5, [&]() {
+      for(int i = 0; i < loop; i++)
+        g_sink += (size_t)impl::EOCDRReader(f).readEOCDRecord()._cdOffset;
+    });
+    printf("eocd lookup (comment %zu bytes): %.3f us/op\n", commentLen, sec/loop*1e6);
+  }
+}
+
+void benchCDParse(bool quick) {
+  std::vector<size_t> nums = {10, 10000};
+  if(!quick)
+    nums.push_back(1000000);
+  for(size_t num : nums) {
+    std::vector<uint8_t> zip = makeArchive(num, 16, false);
+    MemoryFile f(zip.data(), zip.size());
+    int repeat = num >= 1000000 ? 3 : 10;
+    int loop = num <= 10 ? 10000 : 1;
+
+    double lister = measure(repeat, [&]() {
+      for(int i = 0; i < loop; i++) {
+        UnZipper unzipper(f);
+        for(auto& entry : unzipper.listFiles())
+          g_sink += entry.contentSize();
+      }
+    });
+    double staticLister = measure(repeat, [&]() {
+      for(int i = 0; i < loop; i++) {
+        BasicUnZipper<MemoryFile> unzipper(f);
+        for(auto& entry : unzipper.listFiles())
+          g_sink += entry.contentSize();
+      }
+    });
+    double bulk = measure(repeat, [&]() {
+      for(int i = 0; i < loop; i++) {
+        UnZipper unzipper(f);
+        impl::BulkCDReader reader = unzipper.readCentralDirectory();
+        while(!reader.isEnd())
+          g_sink += reader.readOne()._fileNameLength;
+      }
+    });
+    double index = measure(repeat, [&]() {
+      for(int i = 0; i < loop; i++) {
+        UnZipper unzipper(f);
+        unzipper.buildIndex();
+        g_sink += unzipper.index().size();
+      }
+    });
+    printf("cd parse %zu entries: listFiles %.1f us (BasicUnZipper<MemoryFile> %.1f us), BulkCDReader %.1f us, buildIndex %.1f us\n",
+      num, lister/loop*1e6, staticLister/loop*1e6, bulk/loop*1e6, index/loop*1e6);
+  }
+}
+
+void benchSmallFiles() {
+  const size_t num = 10000;
+  for(bool deflate : {false, true}) {
+    std::vector<uint8_t> zip = makeArchive(num, 2048, deflate);
+    MemoryFile f(zip.data(), zip.size());
+    UnZipper unzipper(f);
+    unzipper.buildIndex();
+    double sec = measure(5, [&]() {
+      for(size_t i = 0; i < num; i++)
+        g_sink += unzipper.entryAt(i).readContent().size();
+    });
+    ReusableScratch scratch;
+    std::vector<uint8_t> buf(2048);
+    double intoSec = measure(5, [&]() {
+      for(size_t i = 0; i < num; i++)
+        g_sink += unzipper.entryAt(i).readContentInto(buf.data(), buf.size(), scratch);
+    });
+    std::vector<size_t> all;
+    for(size_t i = num; i-- > 0;)
+      all.push_back(i);
+    double batchSec = measure(5, [&]() {
+      unzipper.readEntries(all, [](FileEntry&, std::vector<uint8_t>& content) { g_sink += content.size(); });
+    });
+    printf("small files (2KB, %s): readContent %.0f ops/s, readContentInto %.0f ops/s, readEntries %.0f ops/s\n",
+      deflate ? "deflated" : "stored", num/sec, num/intoSec, num/batchSec);
+  }
+}
+
+void benchLargeFile() {
+  const size_t size = 64*1024*1024;
+  for(bool deflate : {false, true}) {
+    std::vector<uint8_t> zip = makeArchive(1, size, deflate);
+    MemoryFile f(zip.data(), zip.size());
+    UnZipper unzipper(f);
+    FileEntry entry = unzipper.entryAt(0);
+    double sec = measure(3, [&]() { g_sink += entry.readContent().size(); });
+    std::vector<uint8_t> buf(size);
+    double intoSec = measure(3, [&]() { g_sink += entry.readContentInto(buf.data(), buf.size()); });
+    printf("large file (64MB, %s): readContent %.1f MB/s, readContentInto %.1f MB/s\n",
+      deflate ? "deflated" : "stored", size/sec/1e6, size/intoSec/1e6);
+    if(deflate) {
+      impl::SeekIndex index = entry.buildSeekIndex(size/64);
+      size_t maxThread = std::max(std::thread::hardware_concurrency(), 1u);
+      for(size_t th = 1; th <= maxThread; th *= 2) {
+        double parSec = measure(3, [&]() { g_sink += entry.readContentParallelInto(buf.data(), buf.size(), index, th); });
+        printf("large file (64MB, deflated) readContentParallel %zu threads: %.1f MB/s\n", th, size/parSec/1e6);
+      }
+    }
+  }
+}
+
+void benchExtractAllScaling() {
+  const size_t num = 2000;
+  const size_t contentSize = 64*1024;
+  std::vector<uint8_t> zip = makeArchive(num, contentSize, true);
+  MemoryFile f(zip.data(), zip.size());
+  size_t maxThread = std::max(std::thread::hardware_concurrency(), 1u);
+  double base = 0;
+  for(size_t th = 1; th <= maxThread; th *= 2) {
+    UnZipper unzipper(f);
+    unzipper.buildIndex();
+    double sec = measure(3, [&]() {
+      std::atomic<size_t> total(0);
+      unzipper.extractAll([&total](FileEntry&, std::vector<uint8_t>& content) { total += content.size(); }, th);
+      g_sink += total;
+    });
+    if(th == 1)
+      base = sec;
+    printf("extractAll (%zu x 64KB deflated) %zu threads: %.1f MB/s, x%.2f\n", num, th, num*contentSize/sec/1e6, base/sec);
+  }
+}
+
+int main(int argc, char** argv) {
+  bool quick = argc > 1 && strcmp(argv[1], "quick") == 0;
+
+  benchEOCD();
+  benchCDParse(quick);
+  benchSmallFiles();
+  benchLargeFile();
+  benchExtractAllScaling();
+
+  return 0;
+}
@@ -9,12 +9,78 @@
 #include <cstdint>
 #include <istream>
 #include <stdexcept>
+#include <memory>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <deque>
+#include <list>
+#include <unordered_map>
+
+// define CPPUNZIP_NO_SIMD to disable SSE2/NEON code.
+#ifndef CPPUNZIP_NO_SIMD
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CPPUNZIP_SSE2
+#include <emmintrin.h>
+#elif (defined(__aarch64__) && defined(__ARM_NEON)) || defined(_M_ARM64)
+#define CPPUNZIP_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// define CPPUNZIP_ENABLE_STATS to report reads and inflation to StatsObserver. Otherwise hooks are compiled out.
+#ifdef CPPUNZIP_ENABLE_STATS
+#include <chrono>
+#define CPPUNZIP_STATS(file, call) do { if((file)._observer != nullptr) (file)._observer->call; } while(0)
+#else
+#define CPPUNZIP_STATS(file, call) do {} while(0)
+#endif
+
+// define CPPUNZIP_USE_IO_URING to use IoUringFile (Linux 5.6 or later, no liburing needed).
+#if defined(CPPUNZIP_USE_IO_URING) && defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
 
 // depend on zlib.
+// zlib-ng in zlib compatible mode can be used as is.
 #include <zlib.h>
 
+// define CPPUNZIP_USE_LIBDEFLATE to use libdeflate for whole buffer inflate (and link libdeflate).
+#ifdef CPPUNZIP_USE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+
+// define CPPUNZIP_USE_ZSTD to decode zstd entry (compression method 93, and link libzstd).
+#ifdef CPPUNZIP_USE_ZSTD
+#include <zstd.h>
+#endif
+
 /*
-  Only support compressio method 0 and 8 (no compress and deflate.)
+  Support compression method 0 and 8 (no compress and deflate), 93 (zstd) with CPPUNZIP_USE_ZSTD,
+  and other methods by Decoder registered to impl::DecoderRegistry.
   Only support non-encrypted.
 */
 namespace cppunzip {
@@ -24,29 +90,175 @@ struct UnZipError : public std::runtime_error {
 };
 
 
+/*
+  Receiver of statistics events, set by UnZipper::setStatsObserver (or File::_observer directly).
+  Called only if CPPUNZIP_ENABLE_STATS is defined. Might be called from multiple threads at the same time.
+  Time is in nanoseconds.
+*/
+struct StatsObserver {
+  virtual ~StatsObserver() {}
+
+  // each File::readAt (and completion of File::submitRead). bytes is actually read size.
+  virtual void onRead(size_t /* pos */, size_t /* bytes */) {}
+  // each inflation of whole entry or chunk of stream.
+  virtual void onInflate(size_t /* compressedBytes */, size_t /* uncompressedBytes */, uint64_t /* nanoseconds */) {}
+  // UnZipper::buildIndex (and first index()).
+  virtual void onCentralDirectoryParse(size_t /* entryNum */, uint64_t /* nanoseconds */) {}
+  // whole content of entry is read. Ratio is compressedSize/uncompressedSize.
+  virtual void onEntryRead(const std::string& /* fileName */, uint64_t /* compressedSize */, uint64_t /* uncompressedSize */) {}
+};
+
+/*
+  StatsObserver which sums up all events. Thread safe.
+*/
+struct UnZipStats : public StatsObserver {
+  std::atomic<uint64_t> _readCalls{0};
+  std::atomic<uint64_t> _readBytes{0};
+  std::atomic<uint64_t> _inflateCalls{0};
+  std::atomic<uint64_t> _inflateInBytes{0};
+  std::atomic<uint64_t> _inflateOutBytes{0};
+  std::atomic<uint64_t> _inflateNanos{0};
+  std::atomic<uint64_t> _cdParseNanos{0};
+  std::atomic<uint64_t> _entryNum{0};
+  std::atomic<uint64_t> _entryCompressedBytes{0};
+  std::atomic<uint64_t> _entryUncompressedBytes{0};
+
+  void onRead(size_t /* pos */, size_t bytes) {
+    _readCalls++;
+    _readBytes += bytes;
+  }
+
+  void onInflate(size_t compressedBytes, size_t uncompressedBytes, uint64_t nanoseconds) {
+    _inflateCalls++;
+    _inflateInBytes += compressedBytes;
+    _inflateOutBytes += uncompressedBytes;
+    _inflateNanos += nanoseconds;
+  }
+
+  void onCentralDirectoryParse(size_t /* entryNum */, uint64_t nanoseconds) { _cdParseNanos += nanoseconds; }
+
+  void onEntryRead(const std::string& /* fileName */, uint64_t compressedSize, uint64_t uncompressedSize) {
+    _entryNum++;
+    _entryCompressedBytes += compressedSize;
+    _entryUncompressedBytes += uncompressedSize;
+  }
+
+  // compressed/uncompressed of all read entries.
+  double compressionRatio() const {
+    uint64_t un = _entryUncompressedBytes;
+    return un == 0 ? 1.0 : (double)_entryCompressedBytes / (double)un;
+  }
+};
+
+/*
+  Request of File::submitRead. _result and _done are set on completion, and valid after File::waitRead.
+  Request and dst must be kept alive until waitRead returns.
+*/
+struct ReadRequest {
+  size_t _pos = 0;
+  uint8_t* _dst = nullptr;
+  size_t _size = 0;
+  size_t _result = 0; // read bytes.
+  bool _done = false;
+  bool _failed = false;
+
+  ReadRequest() {}
+  ReadRequest(size_t pos, uint8_t* dst, size_t size) : _pos(pos), _dst(dst), _size(size) {}
+};
+
+/*
+  Random access interface to zip file.
+
+  Concurrency: if supportsConcurrentRead() returns true, readAt and viewAt can be called from multiple threads
+  at the same time without external locking, and so FileEntry::readContent of different (or even same) entries
+  of one opened archive can run concurrently. Otherwise caller must serialize all calls to the File.
+*/
 struct File {
   size_t _size;
+#ifdef CPPUNZIP_ENABLE_STATS
+  StatsObserver* _observer = nullptr;
+#endif
 
   File(size_t size) : _size(size) {}
   virtual ~File(){}
 
   // utility method.
-  int readAt(size_t pos, uint8_t *dst, size_t size) {
+  size_t readAt(size_t pos, uint8_t *dst, size_t size) {
     if(pos > _size)
       throw UnZipError("Try to read outside of file end.");
-    return readAtImpl(pos, dst, size);
+    size_t len = readAtImpl(pos, dst, size);
+    CPPUNZIP_STATS(*this, onRead(pos, len));
+    return len;
   }
 
   void readSpecificSize(size_t offset, uint8_t* dst, size_t size, const std::string& errMsg) {
-    int res = readAt(offset, dst, size);
+    size_t res = readAt(offset, dst, size);
     if(res != size)
       throw UnZipError(errMsg);
   }
 
+  /*
+    Return pointer to [pos, pos+size) if backend holds file content in contiguous memory.
+    Return nullptr if backend does not support it, then use readAt instead.
+  */
+  const uint8_t* viewAt(size_t pos, size_t size) {
+    if(pos > _size || size > _size - pos)
+      return nullptr;
+    return viewAtImpl(pos, size);
+  }
+
+  // true if readAt and viewAt can be called from multiple threads at the same time.
+  virtual bool supportsConcurrentRead() const { return false; }
+
+  /*
+    Asynchronous read. Start reading of all reqs, then wait each with waitRead.
+    Default implementation just reads synchronously in submitRead, so it works with any backend.
+    Thread safety is same as readAt.
+  */
+  void submitRead(ReadRequest* const* reqs, size_t num) {
+    for(size_t i = 0; i < num; i++) {
+      if(reqs[i]->_pos > _size)
+        throw UnZipError("Try to read outside of file end.");
+      reqs[i]->_result = 0;
+      reqs[i]->_done = false;
+      reqs[i]->_failed = false;
+    }
+    submitReadImpl(reqs, num);
+  }
+
+  void submitRead(ReadRequest& req) {
+    ReadRequest* p = &req;
+    submitRead(&p, 1);
+  }
+
+  // block until req completes. Return read bytes.
+  size_t waitRead(ReadRequest& req) {
+    waitReadImpl(req);
+    if(req._failed)
+      throw UnZipError("Fail to read file.");
+    CPPUNZIP_STATS(*this, onRead(req._pos, req._result));
+    return req._result;
+  }
+
+  // true if submitRead returns before read completes, so it is worth to prefetch.
+  virtual bool supportsAsyncRead() const { return false; }
+
 protected:
-  virtual int readAtImpl(size_t pos, uint8_t* dst, size_t size) = 0;
+  virtual size_t readAtImpl(size_t pos, uint8_t* dst, size_t size) = 0;
+  virtual const uint8_t* viewAtImpl(size_t /* pos */, size_t /* size */) { return nullptr; }
+
+  virtual void submitReadImpl(ReadRequest* const* reqs, size_t num) {
+    for(size_t i = 0; i < num; i++) {
+      reqs[i]->_result = readAtImpl(reqs[i]->_pos, reqs[i]->_dst, reqs[i]->_size);
+      reqs[i]->_done = true;
+    }
+  }
+  virtual void waitReadImpl(ReadRequest& /* req */) {}
 };
 
+/*
+  File over std::istream. Not thread safe because readAt changes stream state (seek position).
+*/
 struct IStreamFile : public File {
   std::istream& _istream;
 
@@ -58,362 +270,3241 @@ struct IStreamFile : public File {
   virtual ~IStreamFile() {}
 
 protected:
-  int readAtImpl(size_t pos, uint8_t* dst, size_t size) {
+  size_t readAtImpl(size_t pos, uint8_t* dst, size_t size) {
     _istream.clear();
     _istream.seekg(pos);
     _istream.read((char*)dst, size);
-    return (int)_istream.gcount();
+    return (size_t)_istream.gcount();
   }
 };
 
-
-namespace impl {
-// zip format
-// https://docs.fileformat.com/compression/zip/
-// https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
-
 /*
-  EOCDR: End of Central Directory Record(4.3.16 in spec)
+  Stateless positional read by pread on POSIX (ReadFile with OVERLAPPED on Windows).
+  Unlike IStreamFile, there is no shared seek position, so this supports concurrent read.
 */
+struct PReadFile : public File {
+#ifdef _WIN32
+  HANDLE _handle;
+#else
+  int _fd;
+#endif
 
-struct EOCDRecord {
-
-  /*
-    unsued    
-    signature: 4 (0x06054b50)
-    diskrel1: 2
-    diskrel2: 2
-    diskrel3: 2
-  */
-  // cd stands for central directory
-  uint16_t _cdEntryNum; 
-  uint32_t _cdSize;
-  uint32_t _cdOffset;
-  /*
-    unused
-    commentLen: 2
-  */
+  PReadFile(const std::string& path) : File(0) {
+#ifdef _WIN32
+    _handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(_handle == INVALID_HANDLE_VALUE)
+      throw UnZipError("Fail to open file: " + path);
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(_handle, &size)) {
+      CloseHandle(_handle);
+      throw UnZipError("Fail to get file size: " + path);
+    }
+    _size = (size_t)size.QuadPart;
+#else
+    _fd = open(path.c_str(), O_RDONLY);
+    if(_fd < 0)
+      throw UnZipError("Fail to open file: " + path);
+    struct stat st;
+    if(fstat(_fd, &st) != 0) {
+      close(_fd);
+      throw UnZipError("Fail to get file size: " + path);
+    }
+    _size = (size_t)st.st_size;
+#endif
+  }
 
-  EOCDRecord(uint16_t cdEntryNum, uint32_t cdSize, uint32_t cdOffset) : _cdEntryNum(cdEntryNum), _cdSize(cdSize), _cdOffset(cdOffset) {}
-};
+  PReadFile(const PReadFile&) = delete;
+  PReadFile& operator=(const PReadFile&) = delete;
 
-/*
-  Central Directory header.(4.3.12 in spec)
-*/
-struct CDRecord {
-  /*
-  unused
-  signature: 4(0x02014b50)
-  version made by: 2
-  version need to extract: 2  
-  */
-  uint16_t _flags;
-  uint16_t _compressionMethod;
-  uint16_t _lastModTime;
-  uint16_t _lastModDate;
-  uint32_t _crc;
-  uint32_t _compressedSize;
-  uint32_t _uncompressedSize;
-  uint16_t _fileNameLength;
-  uint16_t _extraFieldLength;
-  uint16_t _commentLength;
-  // not used: disNumberStart: 2bytes
-  uint16_t _internalFileAttrs;
-  uint32_t _externalFileAttrs;
-  uint32_t _localHeaderOffset;
+  virtual ~PReadFile() {
+#ifdef _WIN32
+    CloseHandle(_handle);
+#else
+    close(_fd);
+#endif
+  }
 
-  std::string _fileName;
-  std::vector<uint8_t> _extraField;
-  std::string _comment;
+  bool supportsConcurrentRead() const { return true; }
 
-  bool isDir() const { return (_fileName.size() != 0) && (_fileName[_fileName.size()-1] =='/'); }
+protected:
+  size_t readAtImpl(size_t pos, uint8_t* dst, size_t size) {
+    size_t total = 0;
+    while(total < size) {
+#ifdef _WIN32
+      OVERLAPPED ov = {};
+      uint64_t off = (uint64_t)(pos+total);
+      ov.Offset = (DWORD)off;
+      ov.OffsetHigh = (DWORD)(off >> 32);
+      DWORD len = 0;
+      DWORD req = (DWORD)std::min(size-total, (size_t)0x40000000);
+      if(!ReadFile(_handle, dst+total, req, &len, &ov)) {
+        if(GetLastError() == ERROR_HANDLE_EOF)
+          break;
+        throw UnZipError("Fail to read file.");
+      }
+#else
+      ssize_t len = pread(_fd, dst+total, size-total, (off_t)(pos+total));
+      if(len < 0) {
+        if(errno == EINTR)
+          continue;
+        throw UnZipError("Fail to read file.");
+      }
+#endif
+      if(len == 0)
+        break;
+      total += (size_t)len;
+    }
+    return total;
+  }
 };
 
-inline uint16_t Read2Byte(uint8_t* buf, size_t pos) {
-  return ((uint16_t)buf[pos]) | (((uint16_t)buf[pos+1]) << 8);
-}
-
-inline uint32_t Read4Byte(uint8_t* buf, size_t pos) {
-  return ((uint32_t)buf[pos]) | (((uint32_t)buf[pos+1]) << 8)| (((uint32_t)buf[pos+2]) << 16)| (((uint32_t)buf[pos+3]) << 24);
-}
-
 /*
-  Read Central Directory one by one and return CDRecord.
+  File over archive already in memory (like downloaded buffer). Memory is referred, not copied, and must outlive this File.
+  Supports viewAt, so parsing and inflating are done directly from the buffer, and stored entry is viewed by FileEntry::contentView().
 */
-struct CDReader {
-  File& _file;
-  size_t _curOffset;
-  size_t _endOffset;
+struct MemoryFile : public File {
+  const uint8_t* _data;
 
-  const size_t CDR_SIZE = 46; // except for filename, extra fields, comment.
-
-  CDReader(File& file, size_t curOffset, size_t endOffset) : _file(file), _curOffset(curOffset), _endOffset(endOffset) {}
-  CDReader(File& file, const EOCDRecord& eocd) : CDReader(file, eocd._cdOffset, eocd._cdOffset+eocd._cdSize) {}
-
-  void readSpecificSize(size_t offset, uint8_t* dst, size_t size) {
-    _file.readSpecificSize(offset, dst, size, "Fail to read expected size in CDReader");
+  MemoryFile(const uint8_t* data, size_t size) : File(size), _data(data) {
+    if(_data == nullptr && _size != 0)
+      throw UnZipError("data of MemoryFile must not be null.");
   }
 
-  bool isEnd() const { return _curOffset >= _endOffset; }
-
-  CDRecord readOne()
-  {
-    std::vector<uint8_t> buf(CDR_SIZE);
-    uint8_t* data = buf.data();
-    readSpecificSize(_curOffset, data, CDR_SIZE);
-
-    if (buf[0] != 0x50 || buf[1] != 0x4b || buf[2] != 0x01 || buf[3] != 0x02)
-      throw UnZipError("Central Directory header signature does not match.");
-
-    CDRecord rec;
-    rec._flags = Read2Byte(data, 8);
-    rec._compressionMethod = Read2Byte(data, 10);
-    rec._lastModTime = Read2Byte(data, 12);
-    rec._lastModDate = Read2Byte(data, 14);
-    rec._crc = Read4Byte(data, 16);
-    rec._compressedSize = Read4Byte(data, 20);
-    rec._uncompressedSize = Read4Byte(data, 24);
-    rec._fileNameLength = Read2Byte(data, 28);
-    rec._extraFieldLength = Read2Byte(data, 30);
-    rec._commentLength = Read2Byte(data, 32);
-    // not used: disNumberStart: 2bytes
-    rec._internalFileAttrs = Read2Byte(data, 36);
-    rec._externalFileAttrs = Read4Byte(data, 38);
-    rec._localHeaderOffset = Read4Byte(data, 42);
-
-    // might better be check corrupted length here.
-    rec._fileName.resize(rec._fileNameLength);
-    rec._extraField.resize(rec._extraFieldLength);
-    rec._comment.resize(rec._commentLength);
+  const uint8_t* data() const { return _data; }
 
-    readSpecificSize(_curOffset+46, (uint8_t*)&rec._fileName[0], rec._fileNameLength);
-    readSpecificSize(_curOffset+46+rec._fileNameLength, rec._extraField.data(), rec._extraFieldLength);
-    readSpecificSize(_curOffset+46+rec._fileNameLength+rec._extraFieldLength, (uint8_t*)&rec._comment[0], rec._commentLength);
+  bool supportsConcurrentRead() const { return true; }
 
-    _curOffset = _curOffset+46+rec._fileNameLength+rec._extraFieldLength+rec._commentLength;
-    
-    return rec;
+  // non-virtual versions of File::readAt and viewAt, used by BasicUnZipper<MemoryFile> (and BasicUnZipper<MappedFile>).
+  size_t readAt(size_t pos, uint8_t *dst, size_t size) {
+    if(pos > _size)
+      throw UnZipError("Try to read outside of file end.");
+    size_t len = MemoryFile::readAtImpl(pos, dst, size);
+    CPPUNZIP_STATS(*this, onRead(pos, len));
+    return len;
   }
-  
-};
 
-struct Inflater {
-  void doInflate(uint8_t* srcBuf, size_t srcSize, uint8_t* dstBuf, size_t dstSize) {
-    z_stream s;
-    s.zalloc = Z_NULL;
-    s.zfree = Z_NULL;
-    s.opaque = Z_NULL;
-    s.avail_in = 0;
-    s.next_in = Z_NULL;
+  const uint8_t* viewAt(size_t pos, size_t size) {
+    if(pos > _size || size > _size - pos)
+      return nullptr;
+    return _data+pos;
+  }
 
-    // LZ77 use 32K window size with raw deflate data(no header, negative value means raw deflate data).
-    if(inflateInit2(&s, -15) != Z_OK)
-      throw UnZipError("Fail to initialize zlib inflate.");
-    
-    s.avail_in = (uint32_t)srcSize;
-    s.next_in = srcBuf;
+protected:
+  size_t readAtImpl(size_t pos, uint8_t* dst, size_t size) {
+    size_t len = std::min(size, _size - pos);
+    if(len != 0)
+      memcpy(dst, _data+pos, len);
+    return len;
+  }
 
-    s.avail_out = (uint32_t)dstSize;
-    s.next_out = dstBuf;
+  const uint8_t* viewAtImpl(size_t pos, size_t /* size */) { return _data+pos; }
+};
 
-    int status = inflate( &s, Z_SYNC_FLUSH );
-    inflateEnd( &s );
-    if (status != Z_STREAM_END)
-      throw UnZipError("Fail to inflate: " + std::to_string(status));
+/*
+  Map whole file to memory (mmap on POSIX, MapViewOfFile on Windows).
+  Supports viewAt, so parsing and inflating are done directly from the mapping.
+*/
+struct MappedFile : public MemoryFile {
+#ifdef _WIN32
+  HANDLE _mapping;
+#endif
 
-    if (status == Z_STREAM_END)
-    {
-      // maybe OK, but throw for safety for a while.
-      if (s.total_out != dstSize)
-        throw UnZipError("Not enough deflate result.");
+  MappedFile(const std::string& path) : MemoryFile(nullptr, 0) {
+#ifdef _WIN32
+    _mapping = NULL;
+    HANDLE fh = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(fh == INVALID_HANDLE_VALUE)
+      throw UnZipError("Fail to open file: " + path);
+    LARGE_INTEGER size;
+    if(!GetFileSizeEx(fh, &size)) {
+      CloseHandle(fh);
+      throw UnZipError("Fail to get file size: " + path);
+    }
+    _size = (size_t)size.QuadPart;
+    if(_size != 0) {
+      _mapping = CreateFileMappingA(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+      if(_mapping != NULL)
+        _data = (const uint8_t*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+    }
+    CloseHandle(fh);
+    if(_size != 0 && _data == nullptr) {
+      if(_mapping != NULL)
+        CloseHandle(_mapping);
+      throw UnZipError("Fail to map file: " + path);
     }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+      throw UnZipError("Fail to open file: " + path);
+    struct stat st;
+    if(fstat(fd, &st) != 0) {
+      close(fd);
+      throw UnZipError("Fail to get file size: " + path);
+    }
+    _size = (size_t)st.st_size;
+    if(_size != 0) {
+      void* addr = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if(addr != MAP_FAILED)
+        _data = (const uint8_t*)addr;
+    }
+    // mapping is still valid after close.
+    close(fd);
+    if(_size != 0 && _data == nullptr)
+      throw UnZipError("Fail to map file: " + path);
+#endif
+  }
 
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  virtual ~MappedFile() {
+#ifdef _WIN32
+    if(_data != nullptr)
+      UnmapViewOfFile(_data);
+    if(_mapping != NULL)
+      CloseHandle(_mapping);
+#else
+    if(_data != nullptr)
+      munmap((void*)_data, _size);
+#endif
   }
 };
 
+#if defined(CPPUNZIP_USE_IO_URING) && defined(__linux__)
 /*
-  Read and uncompress CDRecord entry
+  PReadFile with asynchronous read by io_uring, so that many reads are in flight at once (see UnZipper::extractAll).
+  readAt is still synchronous pread. If io_uring is not available (old kernel or blocked), submitRead falls back to synchronous read.
+  Ring is shared by all threads with lock.
 */
-struct CDRContentReader {
-  File& _file;
-  CDRecord _entry;
-  size_t _offset;
+struct IoUringFile : public PReadFile {
+  enum { QUEUE_DEPTH = 64 };
+  const size_t MAX_READ_SIZE = 0x40000000; // longer request is read in multiple.
 
-  const size_t LOCAL_FILE_HEADER_SIZE = 30;
-
-  CDRContentReader(File& file, CDRecord entry) : _file(file), _entry(entry), _offset(0) {
-    _offset = readFileContentOffset();
-  }
-
-  void readSpecificSize(size_t offset, uint8_t* dst, size_t size) {
-    _file.readSpecificSize(offset, dst, size, "Fail to read expected size in CDRContentReader");
-  }
-
-  size_t readFileContentOffset()
-  {
-    std::vector<uint8_t> buf(LOCAL_FILE_HEADER_SIZE);
-    readSpecificSize(_entry._localHeaderOffset, buf.data(), LOCAL_FILE_HEADER_SIZE);
+  int _ringFd = -1;
+  void* _sqRing = MAP_FAILED;
+  size_t _sqRingSize = 0;
+  void* _cqRing = MAP_FAILED;
+  size_t _cqRingSize = 0;
+  io_uring_sqe* _sqes = (io_uring_sqe*)MAP_FAILED;
+  size_t _sqesSize = 0;
 
-    if (buf[0] != 0x50 || buf[1] != 0x4b || buf[2] != 0x03 || buf[3] != 0x04)
-      throw UnZipError("Local File header signature does not match.");
+  unsigned* _sqTail = nullptr;
+  unsigned* _sqMask = nullptr;
+  unsigned* _sqArray = nullptr;
+  unsigned* _cqHead = nullptr;
+  unsigned* _cqTail = nullptr;
+  unsigned* _cqMask = nullptr;
+  io_uring_cqe* _cqes = nullptr;
 
-    uint16_t fnameLen = Read2Byte(buf.data(), 26);
-    uint16_t exFieldLen = Read2Byte(buf.data(), 28);
+  unsigned _inFlight = 0;
+  std::mutex _ringMutex;
 
-    size_t offset = _entry._localHeaderOffset+LOCAL_FILE_HEADER_SIZE+fnameLen+exFieldLen;
+  IoUringFile(const std::string& path) : PReadFile(path) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = (int)syscall(__NR_io_uring_setup, (unsigned)QUEUE_DEPTH, &params);
+    if(fd < 0)
+      return;
+    _ringFd = fd;
 
-    if(offset >= _file._size)
-      throw UnZipError("Wrong local file header. File content offset exceeds file size.");
+    _sqRingSize = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+    _cqRingSize = params.cq_off.cqes + params.cq_entries*sizeof(io_uring_cqe);
+    _sqesSize = params.sq_entries*sizeof(io_uring_sqe);
+    _sqRing = mmap(NULL, _sqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    _cqRing = mmap(NULL, _cqRingSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    _sqes = (io_uring_sqe*)mmap(NULL, _sqesSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(_sqRing == MAP_FAILED || _cqRing == MAP_FAILED || _sqes == (io_uring_sqe*)MAP_FAILED) {
+      closeRing();
+      return;
+    }
 
-    return offset;
+    uint8_t* sq = (uint8_t*)_sqRing;
+    _sqTail = (unsigned*)(sq + params.sq_off.tail);
+    _sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    _sqArray = (unsigned*)(sq + params.sq_off.array);
+    uint8_t* cq = (uint8_t*)_cqRing;
+    _cqHead = (unsigned*)(cq + params.cq_off.head);
+    _cqTail = (unsigned*)(cq + params.cq_off.tail);
+    _cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    _cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
   }
 
-  size_t uncompressedSize() const { return _entry._uncompressedSize; }
-  size_t compressedSize() const { return _entry._compressedSize; }
-  uint16_t compressionMethod() const { return _entry._compressionMethod; }
+  IoUringFile(const IoUringFile&) = delete;
+  IoUringFile& operator=(const IoUringFile&) = delete;
 
-  void readRawContent(uint8_t* dst, size_t size) {
-    if(size != compressedSize())
-      throw UnZipError("dst buffer size and compressed size differs.");
-    
-    int len = _file.readAt(_offset, dst, size);
-    if(len != size)
-      throw UnZipError("Can't read enough in readRawContent.");
+  virtual ~IoUringFile() {
+    if(_ringFd >= 0) {
+      // kernel may still write to dst of in flight requests.
+      std::lock_guard<std::mutex> lock(_ringMutex);
+      while(_inFlight != 0 && reapOne())
+        ;
+    }
+    closeRing();
   }
 
-  std::vector<uint8_t> readRawContent() {
-    std::vector<uint8_t> buf(compressedSize());
+  bool supportsAsyncRead() const { return _ringFd >= 0; }
 
-    readRawContent(buf.data(), compressedSize());
-    return buf;
+protected:
+  void closeRing() {
+    if(_sqes != (io_uring_sqe*)MAP_FAILED)
+      munmap(_sqes, _sqesSize);
+    if(_cqRing != MAP_FAILED)
+      munmap(_cqRing, _cqRingSize);
+    if(_sqRing != MAP_FAILED)
+      munmap(_sqRing, _sqRingSize);
+    if(_ringFd >= 0)
+      close(_ringFd);
+    _ringFd = -1;
   }
 
-  void decompressRawContent(uint8_t* srcBuf, size_t srcSize, uint8_t* dstBuf, size_t dstSize) {
-    if(compressionMethod() == 0)
-      throw UnZipError("File is uncompressed, no need to call decompressRawContent");
-    
-    if(compressionMethod() != 8)
-      throw UnZipError("Only deflate compression is supported");
-
-    if((srcSize < compressedSize()) || (dstSize < uncompressedSize()))
-      throw UnZipError("srcSize or dstSize of decompressRawContent mismatch.");
-    
-    Inflater inflater;
-    inflater.doInflate(srcBuf, compressedSize(), dstBuf, uncompressedSize());
+  int enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    int res;
+    do {
+      res = (int)syscall(__NR_io_uring_enter, _ringFd, toSubmit, minComplete, flags, NULL, 0);
+    } while(res < 0 && errno == EINTR);
+    return res;
   }
 
-  /*
-    read entry file content and inflate if necessary (if no compression, just return raw content)
-  */
-  std::vector<uint8_t> readContent() {
-    std::vector<uint8_t> rawContent = readRawContent();
-    if(compressionMethod() == 0)
-      return rawContent;
-    
-    if(compressionMethod() != 8)
-      throw UnZipError("Only deflate compression is supported");
+  // after error of io_uring itself, complete unsubmitted requests as failed and fall back to synchronous read.
+  void abandonRing(ReadRequest* const* reqs, size_t from, size_t num) {
+    while(_inFlight != 0 && reapOne())
+      ;
+    for(size_t i = from; i < num; i++) {
+      reqs[i]->_done = true;
+      reqs[i]->_failed = true;
+    }
+    closeRing();
+  }
 
-    std::vector<uint8_t> uncompressedBuf(uncompressedSize());
-    decompressRawContent(rawContent.data(), rawContent.size(), uncompressedBuf.data(), uncompressedSize());
-    return uncompressedBuf;
+  // wait and handle one completion. Must be called with _ringMutex locked. Return false on error of io_uring itself.
+  bool reapOne() {
+    unsigned head = *_cqHead;
+    while(head == __atomic_load_n(_cqTail, __ATOMIC_ACQUIRE)) {
+      if(enter(0, 1, IORING_ENTER_GETEVENTS) < 0)
+        return false;
+    }
+    io_uring_cqe* cqe = &_cqes[head & *_cqMask];
+    ReadRequest* req = (ReadRequest*)(uintptr_t)cqe->user_data;
+    if(cqe->res < 0)
+      req->_failed = true;
+    else
+      req->_result = (size_t)cqe->res;
+    req->_done = true;
+    __atomic_store_n(_cqHead, head+1, __ATOMIC_RELEASE);
+    _inFlight--;
+    return true;
   }
 
+  void submitReadImpl(ReadRequest* const* reqs, size_t num) {
+    if(_ringFd < 0) {
+      File::submitReadImpl(reqs, num);
+      return;
+    }
+    std::lock_guard<std::mutex> lock(_ringMutex);
+    size_t i = 0;
+    while(i < num) {
+      unsigned toSubmit = 0;
+      unsigned tail = *_sqTail;
+      for(; i < num && _inFlight+toSubmit < QUEUE_DEPTH; i++, toSubmit++) {
+        ReadRequest* req = reqs[i];
+        unsigned idx = (tail+toSubmit) & *_sqMask;
+        io_uring_sqe* sqe = &_sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = _fd;
+        sqe->off = (uint64_t)req->_pos;
+        sqe->addr = (uint64_t)(uintptr_t)req->_dst;
+        sqe->len = (unsigned)std::min(req->_size, MAX_READ_SIZE);
+        sqe->user_data = (uint64_t)(uintptr_t)req;
+        _sqArray[idx] = idx;
+      }
+      __atomic_store_n(_sqTail, tail+toSubmit, __ATOMIC_RELEASE);
+      if(toSubmit != 0) {
+        int res = enter(toSubmit, 0, 0);
+        if(res > 0)
+          _inFlight += (unsigned)res;
+        if(res != (int)toSubmit) {
+          abandonRing(reqs, i-toSubmit+(size_t)std::max(res, 0), num);
+          throw UnZipError("Fail to submit io_uring read.");
+        }
+      }
+      // queue is full, make room.
+      if(i < num && !reapOne()) {
+        abandonRing(reqs, i, num);
+        throw UnZipError("Fail to wait io_uring read.");
+      }
+    }
+  }
 
+  void waitReadImpl(ReadRequest& req) {
+    {
+      std::lock_guard<std::mutex> lock(_ringMutex);
+      // nothing in flight means req was never submitted, so don't block in reapOne.
+      while(_ringFd >= 0 && !req._done && _inFlight != 0) {
+        if(!reapOne())
+          throw UnZipError("Fail to wait io_uring read.");
+      }
+      // ring is abandoned while in flight, or req is not submitted.
+      if(!req._done)
+        req._failed = true;
+    }
+    // short read (request larger than MAX_READ_SIZE or interrupted), read the rest synchronously.
+    if(!req._failed && req._result != 0 && req._result < req._size)
+      req._result += readAtImpl(req._pos+req._result, req._dst+req._result, req._size-req._result);
+  }
 };
+#endif
 
 /*
-  Entry point.
+  Decorator of other File for high latency backend (like HTTP range request on object storage).
+  Reads are done by blockSize aligned blocks and kept in LRU cache of maxBlocks blocks.
+  Adjacent missing blocks of one read are fetched by one base read, and readAheadBlocks blocks after them are fetched together.
+  Read larger than half of the cache goes to base directly.
+  Thread safe. If base supportsConcurrentRead, base reads are done without lock.
 */
-struct EOCDRReader {
-  File& _file;
+struct CachedFile : public File {
+  File& _base;
+  size_t _blockSize;
+  size_t _maxBlocks;
+  size_t _readAheadBlocks;
 
-  const size_t EOCDR_SIZE = 22; // comment is variable length, so real size is this size plus comment len.
+  struct Block {
+    std::vector<uint8_t> _data;
+    std::list<size_t>::iterator _lruPos;
+  };
+  std::unordered_map<size_t, Block> _blocks;
+  std::list<size_t> _lru; // block number, most recently used first.
+  std::mutex _mutex;
 
-  EOCDRReader(File& zipFile) : _file(zipFile) {}
+  CachedFile(File& base, size_t blockSize = 64*1024, size_t maxBlocks = 256, size_t readAheadBlocks = 1) :
+    File(base._size), _base(base), _blockSize(blockSize), _maxBlocks(maxBlocks), _readAheadBlocks(readAheadBlocks) {
+    if(_blockSize == 0 || _maxBlocks == 0)
+      throw UnZipError("blockSize and maxBlocks of CachedFile must not be zero.");
+  }
 
+  CachedFile(const CachedFile&) = delete;
+  CachedFile& operator=(const CachedFile&) = delete;
 
+  bool supportsConcurrentRead() const { return true; }
 
-  // find 0x06054b50, also check comment len is inside buffer.
-  // if not found, return -1.
-  int findEndOfCDRInBlock(uint8_t* buf, size_t len) {
-    for(int pos = (int)len-(int)EOCDR_SIZE; pos >= 0; pos--) {
-      if(buf[pos+0] == 0x50 && buf[pos+1] == 0x4b && buf[pos+2] == 0x05 && buf[pos+3] == 0x06) {
-        int commentLen = (int)Read2Byte(buf, pos+EOCDR_SIZE-2);
-        if(pos+EOCDR_SIZE+commentLen <= len)
-          return pos;
+  void clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _blocks.clear();
+    _lru.clear();
+  }
+
+protected:
+  // consecutive missing blocks fetched by one base read.
+  struct Run {
+    size_t _first;
+    size_t _num;
+    std::vector<uint8_t> _data;
+    size_t _len;
+  };
+
+  size_t blockLength(size_t block) const { return std::min(_blockSize, _size - block*_blockSize); }
+
+  // return cached block and mark it as most recently used, nullptr if not cached. Must be called with _mutex locked.
+  const std::vector<uint8_t>* findBlock(size_t block) {
+    auto it = _blocks.find(block);
+    if(it == _blocks.end())
+      return nullptr;
+    _lru.splice(_lru.begin(), _lru, it->second._lruPos);
+    return &it->second._data;
+  }
+
+  // Must be called with _mutex locked.
+  void insertBlock(size_t block, const uint8_t* data, size_t len) {
+    if(_blocks.find(block) != _blocks.end())
+      return;
+    while(_blocks.size() >= _maxBlocks) {
+      _blocks.erase(_lru.back());
+      _lru.pop_back();
+    }
+    _lru.push_front(block);
+    Block& b = _blocks[block];
+    b._data.assign(data, data+len);
+    b._lruPos = _lru.begin();
+  }
+
+  size_t readAtImpl(size_t pos, uint8_t* dst, size_t size) {
+    size_t end = pos + std::min(size, _size - pos);
+    if(end == pos)
+      return 0;
+    size_t first = pos/_blockSize;
+    size_t last = (end-1)/_blockSize;
+    std::unique_lock<std::mutex> lock(_mutex, std::defer_lock);
+    // large read bypasses cache, but base still needs the lock if it is not thread safe.
+    if((last-first+1+_readAheadBlocks)*2 > _maxBlocks) {
+      if(!_base.supportsConcurrentRead())
+        lock.lock();
+      return _base.readAt(pos, dst, end-pos);
+    }
+
+    lock.lock();
+    std::vector<Run> runs;
+    for(size_t b = first; b <= last; b++) {
+      if(_blocks.find(b) != _blocks.end())
+        continue;
+      if(!runs.empty() && runs.back()._first+runs.back()._num == b)
+        runs.back()._num++;
+      else
+        runs.push_back(Run{b, 1, std::vector<uint8_t>(), 0});
+    }
+    if(!runs.empty() && runs.back()._first+runs.back()._num == last+1) {
+      size_t blockNum = (_size+_blockSize-1)/_blockSize;
+      for(size_t b = last+1; b <= last+_readAheadBlocks && b < blockNum && _blocks.find(b) == _blocks.end(); b++)
+        runs.back()._num++;
+    }
+
+    if(!runs.empty()) {
+      if(_base.supportsConcurrentRead())
+        lock.unlock();
+      for(auto& run : runs) {
+        size_t start = run._first*_blockSize;
+        run._data.resize(std::min(run._num*_blockSize, _size-start));
+        run._len = _base.readAt(start, run._data.data(), run._data.size());
+      }
+      if(!lock.owns_lock())
+        lock.lock();
+      for(auto& run : runs) {
+        for(size_t i = 0; i < run._num; i++) {
+          size_t len = blockLength(run._first+i);
+          if(i*_blockSize+len > run._len)
+            break;
+          insertBlock(run._first+i, run._data.data()+i*_blockSize, len);
+        }
+      }
+    }
+
+    // copy from fetched runs first because cached blocks may be evicted while lock is released.
+    size_t copied = 0;
+    size_t runIdx = 0;
+    for(size_t b = first; b <= last; b++) {
+      size_t blockStart = b*_blockSize;
+      size_t from = std::max(pos, blockStart) - blockStart;
+      size_t to = std::min(end, blockStart+blockLength(b)) - blockStart;
+      while(runIdx < runs.size() && runs[runIdx]._first+runs[runIdx]._num <= b)
+        runIdx++;
+      size_t got;
+      if(runIdx < runs.size() && runs[runIdx]._first <= b) {
+        const Run& run = runs[runIdx];
+        size_t offset = (b-run._first)*_blockSize;
+        size_t avail = run._len > offset ? std::min(run._len-offset, blockLength(b)) : 0;
+        got = avail > from ? std::min(avail, to)-from : 0;
+        memcpy(dst+copied, run._data.data()+offset+from, got);
+      } else {
+        const std::vector<uint8_t>* data = findBlock(b);
+        if(data != nullptr) {
+          got = to-from;
+          memcpy(dst+copied, data->data()+from, got);
+        } else {
+          got = _base.readAt(blockStart+from, dst+copied, to-from);
+        }
+      }
+      copied += got;
+      if(got != to-from)
+        break;
+    }
+    return copied;
+  }
+};
+
+/*
+  Whole buffer decoder of one compression method, registered to impl::DecoderRegistry.
+  decode is called from multiple threads at the same time (like extractAll), so keep per thread state if needed.
+*/
+struct Decoder {
+  virtual ~Decoder() {}
+  // decode srcSize bytes to exactly dstSize bytes or throw UnZipError. If crc is not nullptr, update *crc by decoded content.
+  virtual void decode(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize, uint32_t* crc) = 0;
+};
+
+/*
+  Allocator of temporary buffer for compressed data used in FileEntry::readContentInto.
+*/
+struct ScratchAllocator {
+  virtual ~ScratchAllocator() {}
+  virtual uint8_t* allocate(size_t size) = 0;
+  virtual void deallocate(uint8_t* ptr, size_t size) = 0;
+};
+
+/*
+  Keep one slab and reuse it for every allocation, so repeated reads cause no heap allocation once slab is large enough.
+  Only one allocation can be alive at a time, and not thread safe (use one per thread).
+*/
+struct ReusableScratch : public ScratchAllocator {
+  std::vector<uint8_t> _slab;
+  bool _inUse = false;
+
+  uint8_t* allocate(size_t size) {
+    if(_inUse)
+      throw UnZipError("ReusableScratch is already in use.");
+    if(_slab.size() < size)
+      _slab.resize(size);
+    _inUse = true;
+    return _slab.data();
+  }
+
+  void deallocate(uint8_t* /* ptr */, size_t /* size */) { _inUse = false; }
+};
+/*
+  Options of reading entry content.
+*/
+struct ReadOptions {
+  // verify CRC-32 of content while reading it, and throw UnZipError on mismatch.
+  bool _verifyCrc = false;
+  /*
+    If data offset is not yet known, read local file header and raw content by one readAt,
+    estimating local header size from central directory. Useful for File without viewAt where each read is costly.
+  */
+  bool _speculativeRead = false;
+  /*
+    Read compressed data of deflated entry by a reader thread ahead of inflation (double buffering),
+    so that I/O and inflation overlap in openStream, readContent and readContentInto. Useful for large entry on File without viewAt.
+    The reader thread uses File while reading, so File must not be used from other threads at the same time unless it supportsConcurrentRead.
+  */
+  bool _pipelinedRead = false;
+};
+
+typedef std::shared_ptr<const std::vector<uint8_t>> SharedContent;
+
+/*
+  LRU cache of decompressed content keyed by archive File and entry index, used by UnZipper::readSharedContent.
+  Content is kept as shared immutable buffer, so hit does not copy and evicted content stays valid while caller holds it.
+  Keys are split into shardNum shards, each with its own LRU list and lock, to keep lock contention low.
+  byteBudget is for all shards. New content evicts least recently used ones of its shard first, then of other shards.
+  Content larger than byteBudget is not cached. Thread safe.
+*/
+struct ContentCache {
+  struct Key {
+    const File* _archive;
+    size_t _index;
+    bool operator==(const Key& other) const { return _archive == other._archive && _index == other._index; }
+  };
+
+  struct KeyHash {
+    size_t operator()(const Key& key) const {
+      return std::hash<const File*>()(key._archive) ^ (key._index*(size_t)0x9e3779b97f4a7c15ULL);
+    }
+  };
+
+  struct Item {
+    Key _key;
+    SharedContent _content;
+  };
+
+  struct Shard {
+    std::mutex _mutex;
+    std::list<Item> _lru; // most recently used first.
+    std::unordered_map<Key, std::list<Item>::iterator, KeyHash> _items;
+    size_t _bytes = 0;
+  };
+
+  std::vector<Shard> _shards;
+  size_t _byteBudget;
+  std::atomic<size_t> _bytes; // sum of _bytes of shards.
+
+  ContentCache(size_t byteBudget, size_t shardNum = 16) : _shards(std::max(shardNum, (size_t)1)), _byteBudget(byteBudget), _bytes(0) {}
+
+  ContentCache(const ContentCache&) = delete;
+  ContentCache& operator=(const ContentCache&) = delete;
+
+  // return cached content and mark it as most recently used, nullptr if not cached.
+  SharedContent find(const File* archive, size_t index) {
+    Key key = { archive, index };
+    Shard& shard = shardOf(key);
+    std::lock_guard<std::mutex> lock(shard._mutex);
+    auto it = shard._items.find(key);
+    if(it == shard._items.end())
+      return SharedContent();
+    shard._lru.splice(shard._lru.begin(), shard._lru, it->second);
+    return it->second->_content;
+  }
+
+  /*
+    Cache content and return it as shared buffer. If the key is already cached (inserted by other thread after miss),
+    cached one is returned and content is discarded.
+  */
+  SharedContent insert(const File* archive, size_t index, std::vector<uint8_t> content) {
+    Key key = { archive, index };
+    size_t bytes = content.size();
+    SharedContent shared = std::make_shared<const std::vector<uint8_t>>(std::move(content));
+    if(bytes > _byteBudget)
+      return shared;
+
+    size_t shardIdx = shardIndexOf(key);
+    {
+      Shard& shard = _shards[shardIdx];
+      std::lock_guard<std::mutex> lock(shard._mutex);
+      auto it = shard._items.find(key);
+      if(it != shard._items.end()) {
+        shard._lru.splice(shard._lru.begin(), shard._lru, it->second);
+        return it->second->_content;
+      }
+      shard._lru.push_front(Item{ key, shared });
+      shard._items[key] = shard._lru.begin();
+      shard._bytes += bytes;
+      _bytes += bytes;
+      // keep the new one.
+      while(_bytes > _byteBudget && shard._lru.size() > 1)
+        evictOne(shard);
+    }
+    // lock one shard at a time, so no lock order problem.
+    for(size_t i = 1; i < _shards.size() && _bytes > _byteBudget; i++) {
+      Shard& other = _shards[(shardIdx+i) % _shards.size()];
+      std::lock_guard<std::mutex> lock(other._mutex);
+      while(_bytes > _byteBudget && !other._lru.empty())
+        evictOne(other);
+    }
+    return shared;
+  }
+
+  // drop content of archive, call this before File is closed (address may be reused by other File).
+  void erase(const File* archive) {
+    for(Shard& shard : _shards) {
+      std::lock_guard<std::mutex> lock(shard._mutex);
+      for(auto it = shard._lru.begin(); it != shard._lru.end();) {
+        if(it->_key._archive == archive) {
+          shard._bytes -= it->_content->size();
+          _bytes -= it->_content->size();
+          shard._items.erase(it->_key);
+          it = shard._lru.erase(it);
+        } else {
+          ++it;
+        }
+      }
+    }
+  }
+
+  void clear() {
+    for(Shard& shard : _shards) {
+      std::lock_guard<std::mutex> lock(shard._mutex);
+      shard._items.clear();
+      shard._lru.clear();
+      _bytes -= shard._bytes;
+      shard._bytes = 0;
+    }
+  }
+
+  // total bytes of cached content.
+  size_t bytes() const { return _bytes; }
+
+private:
+  Shard& shardOf(const Key& key) { return _shards[shardIndexOf(key)]; }
+
+  size_t shardIndexOf(const Key& key) const {
+    // upper bits, lower ones select bucket in shard.
+    size_t h = KeyHash()(key);
+    return (h >> (sizeof(size_t)*4)) % _shards.size();
+  }
+
+  // drop least recently used content of shard. Must be called with its _mutex locked.
+  void evictOne(Shard& shard) {
+    size_t bytes = shard._lru.back()._content->size();
+    shard._bytes -= bytes;
+    _bytes -= bytes;
+    shard._items.erase(shard._lru.back()._key);
+    shard._lru.pop_back();
+  }
+};
+
+namespace impl {
+// zip format
+// https://docs.fileformat.com/compression/zip/
+// https://pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
+
+/*
+  Measure elapsed time for StatsObserver. Empty if CPPUNZIP_ENABLE_STATS is not defined.
+*/
+struct StatsTimer {
+#ifdef CPPUNZIP_ENABLE_STATS
+  std::chrono::steady_clock::time_point _begin;
+
+  StatsTimer() : _begin(std::chrono::steady_clock::now()) {}
+
+  uint64_t elapsed() const {
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _begin).count();
+  }
+#else
+  StatsTimer() {}
+#endif
+};
+
+inline uint16_t Read2Byte(const uint8_t* buf, size_t pos) {
+  return ((uint16_t)buf[pos]) | (((uint16_t)buf[pos+1]) << 8);
+}
+
+inline uint32_t Read4Byte(const uint8_t* buf, size_t pos) {
+  return ((uint32_t)buf[pos]) | (((uint32_t)buf[pos+1]) << 8)| (((uint32_t)buf[pos+2]) << 16)| (((uint32_t)buf[pos+3]) << 24);
+}
+
+inline uint64_t Read8Byte(const uint8_t* buf, size_t pos) {
+  return ((uint64_t)Read4Byte(buf, pos)) | (((uint64_t)Read4Byte(buf, pos+4)) << 32);
+}
+
+inline void Write2Byte(std::vector<uint8_t>& buf, uint16_t val) {
+  buf.push_back((uint8_t)val);
+  buf.push_back((uint8_t)(val >> 8));
+}
+
+inline void Write4Byte(std::vector<uint8_t>& buf, uint32_t val) {
+  Write2Byte(buf, (uint16_t)val);
+  Write2Byte(buf, (uint16_t)(val >> 16));
+}
+
+inline void Write8Byte(std::vector<uint8_t>& buf, uint64_t val) {
+  Write4Byte(buf, (uint32_t)val);
+  Write4Byte(buf, (uint32_t)(val >> 32));
+}
+
+/*
+  File::readSpecificSize through FileT, so that readAt of concrete backend (see BasicUnZipper) is called without virtual dispatch.
+*/
+template<class FileT>
+void ReadSpecificSize(FileT& file, size_t offset, uint8_t* dst, size_t size, const std::string& errMsg) {
+  if(file.readAt(offset, dst, size) != size)
+    throw UnZipError(errMsg);
+}
+
+/*
+  CRC-32 of zip (same as zlib crc32, which uses hardware CRC/PCLMULQDQ in recent zlib and zlib-ng).
+  zlib crc32 takes 32bit length, so split for large buffer.
+*/
+inline uint32_t UpdateCrc(uint32_t crc, const uint8_t* buf, size_t len) {
+  const size_t MAX_CHUNK = (size_t)1 << 30;
+  while(len != 0) {
+    size_t chunk = std::min(len, MAX_CHUNK);
+#ifdef CPPUNZIP_USE_LIBDEFLATE
+    crc = libdeflate_crc32(crc, buf, chunk);
+#else
+    crc = (uint32_t)crc32(crc, buf, (uInt)chunk);
+#endif
+    buf += chunk;
+    len -= chunk;
+  }
+  return crc;
+}
+
+/*
+  EOCDR: End of Central Directory Record(4.3.16 in spec)
+*/
+
+struct EOCDRecord {
+
+  /*
+    unsued    
+    signature: 4 (0x06054b50)
+    diskrel1: 2
+    diskrel2: 2
+    diskrel3: 2
+  */
+  // cd stands for central directory
+  // 64bit to hold values of Zip64 end of central directory record(4.3.14 in spec).
+  uint64_t _cdEntryNum;
+  uint64_t _cdSize;
+  uint64_t _cdOffset;
+  /*
+    unused
+    commentLen: 2
+  */
+
+  // file offset of this record (not Zip64 one).
+  uint64_t _eocdOffset = 0;
+
+  EOCDRecord(uint64_t cdEntryNum, uint64_t cdSize, uint64_t cdOffset) : _cdEntryNum(cdEntryNum), _cdSize(cdSize), _cdOffset(cdOffset) {}
+};
+
+/*
+  Central Directory header.(4.3.12 in spec)
+  Fixed size part only, see CDRecord and CDRecordView for variable length part.
+*/
+struct CDHeader {
+  /*
+  unused
+  signature: 4(0x02014b50)
+  version made by: 2
+  version need to extract: 2  
+  */
+  uint16_t _flags;
+  uint16_t _compressionMethod;
+  uint16_t _lastModTime;
+  uint16_t _lastModDate;
+  uint32_t _crc;
+  // 64bit to hold values of Zip64 extended information extra field.
+  uint64_t _compressedSize;
+  uint64_t _uncompressedSize;
+  uint16_t _fileNameLength;
+  uint16_t _extraFieldLength;
+  uint16_t _commentLength;
+  // not used: disNumberStart: 2bytes
+  uint16_t _internalFileAttrs;
+  uint32_t _externalFileAttrs;
+  uint64_t _localHeaderOffset;
+
+  // data must point 46 bytes fixed size part starting with signature.
+  void parseHeader(const uint8_t* data) {
+    if (data[0] != 0x50 || data[1] != 0x4b || data[2] != 0x01 || data[3] != 0x02)
+      throw UnZipError("Central Directory header signature does not match.");
+
+    _flags = Read2Byte(data, 8);
+    _compressionMethod = Read2Byte(data, 10);
+    _lastModTime = Read2Byte(data, 12);
+    _lastModDate = Read2Byte(data, 14);
+    _crc = Read4Byte(data, 16);
+    _compressedSize = Read4Byte(data, 20);
+    _uncompressedSize = Read4Byte(data, 24);
+    _fileNameLength = Read2Byte(data, 28);
+    _extraFieldLength = Read2Byte(data, 30);
+    _commentLength = Read2Byte(data, 32);
+    // not used: disNumberStart: 2bytes
+    _internalFileAttrs = Read2Byte(data, 36);
+    _externalFileAttrs = Read4Byte(data, 38);
+    _localHeaderOffset = Read4Byte(data, 42);
+  }
+
+  /*
+    Replace 0xFFFFFFFF values by Zip64 extended information extra field (4.5.3 in spec) if exists.
+    Fields in extra field appear only for values which are 0xFFFFFFFF in the header, in this order.
+  */
+  void applyZip64Extra(const uint8_t* extra, size_t len) {
+    size_t pos = 0;
+    while(pos+4 <= len) {
+      uint16_t id = Read2Byte(extra, pos);
+      uint16_t size = Read2Byte(extra, pos+2);
+      pos += 4;
+      if(pos+size > len)
+        throw UnZipError("Extra field exceeds its length.");
+
+      if(id == 0x0001) {
+        const uint8_t* field = extra+pos;
+        size_t fpos = 0;
+        if(_uncompressedSize == 0xFFFFFFFF) {
+          if(fpos+8 > size)
+            throw UnZipError("Zip64 extra field is too short.");
+          _uncompressedSize = Read8Byte(field, fpos);
+          fpos += 8;
+        }
+        if(_compressedSize == 0xFFFFFFFF) {
+          if(fpos+8 > size)
+            throw UnZipError("Zip64 extra field is too short.");
+          _compressedSize = Read8Byte(field, fpos);
+          fpos += 8;
+        }
+        if(_localHeaderOffset == 0xFFFFFFFF) {
+          if(fpos+8 > size)
+            throw UnZipError("Zip64 extra field is too short.");
+          _localHeaderOffset = Read8Byte(field, fpos);
+        }
+        return;
+      }
+      pos += size;
+    }
+  }
+
+  // whole record size including variable length part.
+  size_t recordSize() const { return 46+(size_t)_fileNameLength+_extraFieldLength+_commentLength; }
+};
+
+struct CDRecord : public CDHeader {
+  std::string _fileName;
+  std::vector<uint8_t> _extraField;
+  std::string _comment;
+
+  bool isDir() const { return (_fileName.size() != 0) && (_fileName[_fileName.size()-1] =='/'); }
+};
+
+/*
+  CDRecord which variable length part points to the buffer of BulkCDReader. No allocation.
+  Valid only while the BulkCDReader is alive.
+*/
+struct CDRecordView : public CDHeader {
+  const char* _fileName;
+  const uint8_t* _extraField;
+  const char* _comment;
+
+  bool isDir() const { return (_fileNameLength != 0) && (_fileName[_fileNameLength-1] =='/'); }
+  std::string fileName() const { return std::string(_fileName, _fileNameLength); }
+
+  CDRecord toRecord() const {
+    CDRecord rec;
+    static_cast<CDHeader&>(rec) = *this;
+    rec._fileName.assign(_fileName, _fileNameLength);
+    rec._extraField.assign(_extraField, _extraField+_extraFieldLength);
+    rec._comment.assign(_comment, _commentLength);
+    return rec;
+  }
+};
+
+/*
+  Read Central Directory one by one and return CDRecord.
+*/
+template<class FileT>
+struct BasicCDReader {
+  FileT& _file;
+  size_t _curOffset;
+  size_t _endOffset;
+
+  const size_t CDR_SIZE = 46; // except for filename, extra fields, comment.
+
+  BasicCDReader(FileT& file, size_t curOffset, size_t endOffset) : _file(file), _curOffset(curOffset), _endOffset(endOffset) {}
+  BasicCDReader(FileT& file, const EOCDRecord& eocd) : BasicCDReader(file, eocd._cdOffset, eocd._cdOffset+eocd._cdSize) {}
+
+  void readSpecificSize(size_t offset, uint8_t* dst, size_t size) {
+    ReadSpecificSize(_file, offset, dst, size, "Fail to read expected size in CDReader");
+  }
+
+  bool isEnd() const { return _curOffset >= _endOffset; }
+
+  CDRecord readOne()
+  {
+    CDRecord rec;
+    readOne(rec);
+    return rec;
+  }
+
+  /*
+    Read next record to rec. Buffers of rec are reused, so reading many records by one CDRecord
+    does not allocate once buffers are large enough.
+  */
+  void readOne(CDRecord& rec)
+  {
+    uint8_t buf[46];
+    const uint8_t* data = _file.viewAt(_curOffset, CDR_SIZE);
+    if(data == nullptr) {
+      readSpecificSize(_curOffset, buf, CDR_SIZE);
+      data = buf;
+    }
+
+    rec.parseHeader(data);
+
+    size_t varLen = (size_t)rec._fileNameLength+rec._extraFieldLength+rec._commentLength;
+    const uint8_t* var = _file.viewAt(_curOffset+46, varLen);
+    if(var != nullptr) {
+      rec._fileName.assign((const char*)var, rec._fileNameLength);
+      rec._extraField.assign(var+rec._fileNameLength, var+rec._fileNameLength+rec._extraFieldLength);
+      rec._comment.assign((const char*)var+rec._fileNameLength+rec._extraFieldLength, rec._commentLength);
+      rec.applyZip64Extra(rec._extraField.data(), rec._extraField.size());
+      _curOffset = _curOffset+46+varLen;
+      return;
+    }
+
+    // might better be check corrupted length here.
+    rec._fileName.resize(rec._fileNameLength);
+    rec._extraField.resize(rec._extraFieldLength);
+    rec._comment.resize(rec._commentLength);
+
+    readSpecificSize(_curOffset+46, (uint8_t*)&rec._fileName[0], rec._fileNameLength);
+    readSpecificSize(_curOffset+46+rec._fileNameLength, rec._extraField.data(), rec._extraFieldLength);
+    readSpecificSize(_curOffset+46+rec._fileNameLength+rec._extraFieldLength, (uint8_t*)&rec._comment[0], rec._commentLength);
+    rec.applyZip64Extra(rec._extraField.data(), rec._extraField.size());
+
+    _curOffset = _curOffset+46+rec._fileNameLength+rec._extraFieldLength+rec._commentLength;
+  }
+  
+};
+
+typedef BasicCDReader<File> CDReader;
+
+/*
+  Read whole Central Directory by one readAt (or viewAt) and parse records from the buffer.
+  Returned CDRecordView points to the buffer, so no allocation per record.
+*/
+template<class FileT>
+struct BasicBulkCDReader {
+  std::vector<uint8_t> _buf;
+  const uint8_t* _data;
+  size_t _size;
+  size_t _pos;
+  size_t _cdOffset;
+
+  const size_t CDR_SIZE = 46; // except for filename, extra fields, comment.
+
+  BasicBulkCDReader(FileT& file, size_t cdOffset, size_t cdSize) : _data(nullptr), _size(cdSize), _pos(0), _cdOffset(cdOffset) {
+    // sizes come from End of Central Directory Record, check before allocating the buffer.
+    if(cdOffset > file._size || cdSize > file._size - cdOffset)
+      throw UnZipError("Wrong Central Directory offset or size. Exceeds file size.");
+    _data = file.viewAt(cdOffset, cdSize);
+    if(_data == nullptr) {
+      _buf.resize(cdSize);
+      ReadSpecificSize(file, cdOffset, _buf.data(), cdSize, "Fail to read whole Central Directory in BulkCDReader");
+      _data = _buf.data();
+    }
+  }
+  BasicBulkCDReader(FileT& file, const EOCDRecord& eocd) : BasicBulkCDReader(file, eocd._cdOffset, eocd._cdSize) {}
+
+  bool isEnd() const { return _pos >= _size; }
+
+  // file offset of next record.
+  size_t curOffset() const { return _cdOffset+_pos; }
+
+  CDRecordView readOne() {
+    if(_size - _pos < CDR_SIZE)
+      throw UnZipError("Central Directory record exceeds Central Directory size.");
+
+    CDRecordView rec;
+    const uint8_t* data = _data+_pos;
+    rec.parseHeader(data);
+    if(_size - _pos < rec.recordSize())
+      throw UnZipError("Central Directory record exceeds Central Directory size.");
+
+    rec._fileName = (const char*)data+CDR_SIZE;
+    rec._extraField = data+CDR_SIZE+rec._fileNameLength;
+    rec._comment = (const char*)rec._extraField+rec._extraFieldLength;
+    rec.applyZip64Extra(rec._extraField, rec._extraFieldLength);
+
+    _pos += rec.recordSize();
+    return rec;
+  }
+};
+
+typedef BasicBulkCDReader<File> BulkCDReader;
+
+/*
+  Read Central Directory by pages of blockSize bytes on demand and return CDRecordView into the current page.
+  Memory is bounded by the page (or the largest record), and reading stops when caller stops, so
+  finding first few entries of huge archive does not read whole Central Directory.
+  If File supports viewAt, whole Central Directory is viewed without read.
+*/
+template<class FileT>
+struct BasicPagedCDReader {
+  FileT& _file;
+  std::vector<uint8_t> _buf;
+  const uint8_t* _data; // page, view or _buf.
+  size_t _pageOffset; // file offset of _data[0].
+  size_t _pageLen;
+  size_t _curOffset;
+  size_t _endOffset;
+  size_t _blockSize;
+
+  const size_t CDR_SIZE = 46; // except for filename, extra fields, comment.
+
+  BasicPagedCDReader(FileT& file, size_t cdOffset, size_t cdSize, size_t blockSize = 256*1024) :
+    _file(file), _data(nullptr), _pageOffset(cdOffset), _pageLen(0), _curOffset(cdOffset), _endOffset(cdOffset+cdSize), _blockSize(blockSize) {
+    if(_blockSize == 0)
+      throw UnZipError("blockSize of PagedCDReader must not be zero.");
+    _data = file.viewAt(cdOffset, cdSize);
+    if(_data != nullptr)
+      _pageLen = cdSize;
+  }
+  BasicPagedCDReader(FileT& file, const EOCDRecord& eocd, size_t blockSize = 256*1024) : BasicPagedCDReader(file, eocd._cdOffset, eocd._cdSize, blockSize) {}
+
+  bool isEnd() const { return _curOffset >= _endOffset; }
+
+  // file offset of next record.
+  size_t curOffset() const { return _curOffset; }
+
+  // Returned view is valid until next readOne.
+  CDRecordView readOne() {
+    if(_endOffset - _curOffset < CDR_SIZE)
+      throw UnZipError("Central Directory record exceeds Central Directory size.");
+
+    CDRecordView rec;
+    rec.parseHeader(ensure(CDR_SIZE));
+    if(_endOffset - _curOffset < rec.recordSize())
+      throw UnZipError("Central Directory record exceeds Central Directory size.");
+
+    const uint8_t* data = ensure(rec.recordSize());
+    rec._fileName = (const char*)data+CDR_SIZE;
+    rec._extraField = data+CDR_SIZE+rec._fileNameLength;
+    rec._comment = (const char*)rec._extraField+rec._extraFieldLength;
+    rec.applyZip64Extra(rec._extraField, rec._extraFieldLength);
+
+    _curOffset += rec.recordSize();
+    return rec;
+  }
+
+private:
+  // return pointer to len bytes at _curOffset. Read next page from _curOffset if they are not in the current page.
+  const uint8_t* ensure(size_t len) {
+    if(_curOffset-_pageOffset+len <= _pageLen)
+      return _data+(_curOffset-_pageOffset);
+
+    size_t readLen = std::min(std::max(_blockSize, len), _endOffset-_curOffset);
+    _buf.resize(readLen);
+    ReadSpecificSize(_file, _curOffset, _buf.data(), readLen, "Fail to read Central Directory in PagedCDReader");
+    _data = _buf.data();
+    _pageOffset = _curOffset;
+    _pageLen = readLen;
+    return _data;
+  }
+};
+
+typedef BasicPagedCDReader<File> PagedCDReader;
+
+/*
+  Inflate backend.
+  Backend inflates whole raw deflate data of known size by doInflate(srcBuf, srcSize, dstBuf, dstSize, crc),
+  and provides one instance per thread by static ThreadLocal().
+  If crc is not nullptr, backend updates *crc by inflated content.
+  Backend is selected at compile time by typedef Inflater below.
+  Streaming read (CDRContentStream) always uses zlib z_stream.
+*/
+
+/*
+  Long lived raw deflate inflater. z_stream is initialized once and reset between entries,
+  so that zlib state is not allocated and freed per entry.
+  Not thread safe, use ThreadLocal() to share one per thread.
+*/
+struct ZlibInflater {
+  z_stream _s;
+
+  ZlibInflater() {
+    _s.zalloc = Z_NULL;
+    _s.zfree = Z_NULL;
+    _s.opaque = Z_NULL;
+    _s.avail_in = 0;
+    _s.next_in = Z_NULL;
+
+    // LZ77 use 32K window size with raw deflate data(no header, negative value means raw deflate data).
+    if(inflateInit2(&_s, -15) != Z_OK)
+      throw UnZipError("Fail to initialize zlib inflate.");
+  }
+
+  // z_stream internal state points back to z_stream, so it can't be copied or moved.
+  ZlibInflater(const ZlibInflater&) = delete;
+  ZlibInflater& operator=(const ZlibInflater&) = delete;
+
+  ~ZlibInflater() { inflateEnd(&_s); }
+
+  static ZlibInflater& ThreadLocal() {
+    static thread_local ZlibInflater inflater;
+    return inflater;
+  }
+
+  const size_t CRC_CHUNK = 64*1024;
+
+  void doInflate(const uint8_t* srcBuf, size_t srcSize, uint8_t* dstBuf, size_t dstSize, uint32_t* crc = nullptr) {
+    z_stream& s = _s;
+    if(inflateReset(&s) != Z_OK)
+      throw UnZipError("Fail to reset zlib inflate.");
+
+    // avail_in and avail_out are 32bit, so feed Zip64 size entry by MAX_CHUNK.
+    const size_t MAX_CHUNK = (size_t)1 << 30;
+    // with crc, inflate by small output chunk and update crc while the chunk is still in cache.
+    const size_t outChunk = crc != nullptr ? CRC_CHUNK : MAX_CHUNK;
+    // empty entry still has a deflate stream (at least an empty final block), but zlib rejects null next_out.
+    // So give a 1 byte dummy output which must stay unused, and run to Z_STREAM_END.
+    if(dstSize == 0) {
+      uint8_t dummy;
+      s.next_in = (Bytef*)srcBuf;
+      s.avail_in = (uint32_t)std::min(srcSize, MAX_CHUNK);
+      s.next_out = &dummy;
+      s.avail_out = 1;
+      int status = inflate( &s, Z_FINISH );
+      if (status != Z_STREAM_END)
+        throw UnZipError("Fail to inflate: " + std::to_string(status));
+      if (s.avail_out != 1)
+        throw UnZipError("Deflate result is larger than uncompressed size.");
+      return;
+    }
+
+    uint8_t* crcDone = dstBuf;
+    size_t srcLeft = srcSize;
+    size_t dstLeft = dstSize;
+    s.next_in = (Bytef*)srcBuf;
+    s.avail_in = 0;
+    s.next_out = dstBuf;
+    s.avail_out = 0;
+
+    int status;
+    while(true) {
+      if(s.avail_in == 0 && srcLeft != 0) {
+        size_t len = std::min(srcLeft, MAX_CHUNK);
+        s.avail_in = (uint32_t)len;
+        srcLeft -= len;
+      }
+      if(s.avail_out == 0 && dstLeft != 0) {
+        size_t len = std::min(dstLeft, outChunk);
+        s.avail_out = (uint32_t)len;
+        dstLeft -= len;
+      }
+
+      status = inflate( &s, Z_SYNC_FLUSH );
+      if (crc != nullptr) {
+        *crc = UpdateCrc(*crc, crcDone, s.next_out-crcDone);
+        crcDone = s.next_out;
+      }
+      if (status == Z_STREAM_END)
+        break;
+      if (status != Z_OK && status != Z_BUF_ERROR)
+        throw UnZipError("Fail to inflate: " + std::to_string(status));
+      // no progress is possible any more.
+      if ((s.avail_in == 0 && srcLeft == 0) || (s.avail_out == 0 && dstLeft == 0))
+        throw UnZipError("Fail to inflate: " + std::to_string(status));
+    }
+
+    // maybe OK, but throw for safety for a while.
+    if (dstLeft != 0 || s.avail_out != 0)
+      throw UnZipError("Not enough deflate result.");
+
+  }
+};
+
+#ifdef CPPUNZIP_USE_LIBDEFLATE
+/*
+  Whole buffer inflater by libdeflate. Faster than zlib because it knows the whole input and output.
+*/
+struct LibdeflateInflater {
+  libdeflate_decompressor* _decompressor;
+
+  LibdeflateInflater() : _decompressor(libdeflate_alloc_decompressor()) {
+    if(_decompressor == nullptr)
+      throw UnZipError("Fail to allocate libdeflate decompressor.");
+  }
+
+  LibdeflateInflater(const LibdeflateInflater&) = delete;
+  LibdeflateInflater& operator=(const LibdeflateInflater&) = delete;
+
+  ~LibdeflateInflater() { libdeflate_free_decompressor(_decompressor); }
+
+  static LibdeflateInflater& ThreadLocal() {
+    static thread_local LibdeflateInflater inflater;
+    return inflater;
+  }
+
+  void doInflate(const uint8_t* srcBuf, size_t srcSize, uint8_t* dstBuf, size_t dstSize, uint32_t* crc = nullptr) {
+    size_t actual = 0;
+    // dstBuf can be null for empty entry, keep out pointer valid anyway.
+    uint8_t dummy;
+    libdeflate_result res = libdeflate_deflate_decompress(_decompressor, srcBuf, srcSize, dstSize != 0 ? dstBuf : &dummy, dstSize, &actual);
+    if(res != LIBDEFLATE_SUCCESS)
+      throw UnZipError("Fail to inflate: " + std::to_string((int)res));
+    if(actual != dstSize)
+      throw UnZipError("Not enough deflate result.");
+    // libdeflate can't inflate partially, so crc is a separate pass.
+    if(crc != nullptr)
+      *crc = UpdateCrc(*crc, dstBuf, dstSize);
+  }
+};
+#endif
+
+/*
+  Define CPPUNZIP_INFLATER to your own backend class to replace the default.
+*/
+#if defined(CPPUNZIP_INFLATER)
+typedef CPPUNZIP_INFLATER Inflater;
+#elif defined(CPPUNZIP_USE_LIBDEFLATE)
+typedef LibdeflateInflater Inflater;
+#else
+typedef ZlibInflater Inflater;
+#endif
+
+struct DeflateDecoder : public Decoder {
+  void decode(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize, uint32_t* crc) {
+    Inflater::ThreadLocal().doInflate(src, srcSize, dst, dstSize, crc);
+  }
+};
+
+#ifdef CPPUNZIP_USE_ZSTD
+/*
+  zstd in zip (compression method 93). Content of the entry is one or more zstd frames.
+*/
+struct ZstdDecoder : public Decoder {
+  struct DCtxDeleter {
+    void operator()(ZSTD_DCtx* ctx) const { ZSTD_freeDCtx(ctx); }
+  };
+
+  static ZSTD_DCtx* ThreadLocalContext() {
+    static thread_local std::unique_ptr<ZSTD_DCtx, DCtxDeleter> ctx(ZSTD_createDCtx());
+    if(!ctx)
+      throw UnZipError("Fail to allocate zstd decompression context.");
+    return ctx.get();
+  }
+
+  void decode(const uint8_t* src, size_t srcSize, uint8_t* dst, size_t dstSize, uint32_t* crc) {
+    size_t res = ZSTD_decompressDCtx(ThreadLocalContext(), dst, dstSize, src, srcSize);
+    if(ZSTD_isError(res))
+      throw UnZipError(std::string("Fail to decompress zstd: ") + ZSTD_getErrorName(res));
+    if(res != dstSize)
+      throw UnZipError("Not enough zstd result.");
+    if(crc != nullptr)
+      *crc = UpdateCrc(*crc, dst, dstSize);
+  }
+};
+#endif
+
+/*
+  Decoder by compression method, used by whole buffer reads (readContent, readContentInto, extractAll and readEntries).
+  Default() has deflate (8), and zstd (93) with CPPUNZIP_USE_ZSTD. Stored (0) is copied without decoder.
+  Deflate64 (9) and others are not built in, add your Decoder for them. Register before reading entries,
+  add is not synchronized with lookups. Streaming read (openStream, readRange) supports only stored and deflate.
+
+  impl::DecoderRegistry::Default().add(9, std::make_shared<MyDeflate64Decoder>());
+*/
+struct DecoderRegistry {
+  std::unordered_map<uint16_t, std::shared_ptr<Decoder>> _decoders;
+
+  DecoderRegistry() {
+    add(8, std::make_shared<DeflateDecoder>());
+#ifdef CPPUNZIP_USE_ZSTD
+    add(93, std::make_shared<ZstdDecoder>());
+#endif
+  }
+
+  static DecoderRegistry& Default() {
+    static DecoderRegistry registry;
+    return registry;
+  }
+
+  // replace existing one if method is already registered.
+  void add(uint16_t method, std::shared_ptr<Decoder> decoder) { _decoders[method] = std::move(decoder); }
+
+  void remove(uint16_t method) { _decoders.erase(method); }
+
+  // return nullptr if not registered.
+  Decoder* find(uint16_t method) const {
+    auto it = _decoders.find(method);
+    return it == _decoders.end() ? nullptr : it->second.get();
+  }
+
+  bool supports(uint16_t method) const { return method == 0 || find(method) != nullptr; }
+};
+
+/*
+  Seek points of deflated entry for random access (same as zlib's examples/zran.c).
+  Each point keeps 32KB window just before the point and bit position of deflate block boundary,
+  so that inflation can restart from the point.
+  Index can be serialized and reused across processes.
+*/
+struct SeekIndex {
+  struct Point {
+    uint64_t _out; // uncompressed offset
+    uint64_t _in; // compressed offset of the first byte after the point
+    uint8_t _bits; // unused bits in the byte before _in, 0 to 7
+  };
+
+  enum { WINDOW_SIZE = 32768 };
+
+  // to check the index is built for the entry.
+  uint64_t _compressedSize = 0;
+  uint64_t _uncompressedSize = 0;
+  uint32_t _crc = 0;
+  uint64_t _span = 0;
+
+  std::vector<Point> _points;
+  // WINDOW_SIZE bytes for each point.
+  std::vector<uint8_t> _windows;
+
+  bool empty() const { return _points.empty(); }
+  size_t size() const { return _points.size(); }
+  const uint8_t* window(size_t idx) const { return _windows.data()+idx*WINDOW_SIZE; }
+
+  // last point whose _out <= offset. -1 if not found.
+  int findPoint(uint64_t offset) const {
+    size_t lo = 0, hi = _points.size();
+    while(lo < hi) {
+      size_t mid = (lo+hi)/2;
+      if(_points[mid]._out <= offset)
+        lo = mid+1;
+      else
+        hi = mid;
+    }
+    return (int)lo-1;
+  }
+
+  bool isFor(const CDHeader& entry) const {
+    return _compressedSize == entry._compressedSize && _uncompressedSize == entry._uncompressedSize && _crc == entry._crc;
+  }
+
+  std::vector<uint8_t> serialize() const {
+    std::vector<uint8_t> buf;
+    buf.reserve(44+_points.size()*(17+WINDOW_SIZE));
+    buf.push_back('C');
+    buf.push_back('U');
+    buf.push_back('Z');
+    buf.push_back('S');
+    Write4Byte(buf, 1); // version
+    Write8Byte(buf, _compressedSize);
+    Write8Byte(buf, _uncompressedSize);
+    Write4Byte(buf, _crc);
+    Write8Byte(buf, _span);
+    Write8Byte(buf, _points.size());
+    for(size_t i = 0; i < _points.size(); i++) {
+      Write8Byte(buf, _points[i]._out);
+      Write8Byte(buf, _points[i]._in);
+      buf.push_back(_points[i]._bits);
+      buf.insert(buf.end(), window(i), window(i)+WINDOW_SIZE);
+    }
+    return buf;
+  }
+
+  static SeekIndex Deserialize(const uint8_t* data, size_t size) {
+    const size_t HEADER_SIZE = 44;
+    const size_t POINT_SIZE = 17+WINDOW_SIZE;
+    if(size < HEADER_SIZE || data[0] != 'C' || data[1] != 'U' || data[2] != 'Z' || data[3] != 'S' || Read4Byte(data, 4) != 1)
+      throw UnZipError("Not a serialized SeekIndex.");
+
+    SeekIndex index;
+    index._compressedSize = Read8Byte(data, 8);
+    index._uncompressedSize = Read8Byte(data, 16);
+    index._crc = Read4Byte(data, 24);
+    index._span = Read8Byte(data, 28);
+    uint64_t num = Read8Byte(data, 36);
+    if(num > (size-HEADER_SIZE)/POINT_SIZE || size != HEADER_SIZE+num*POINT_SIZE)
+      throw UnZipError("Serialized SeekIndex size mismatch.");
+
+    index._points.resize((size_t)num);
+    index._windows.resize((size_t)num*WINDOW_SIZE);
+    for(size_t i = 0; i < num; i++) {
+      const uint8_t* p = data+HEADER_SIZE+i*POINT_SIZE;
+      index._points[i]._out = Read8Byte(p, 0);
+      index._points[i]._in = Read8Byte(p, 8);
+      index._points[i]._bits = p[16];
+      if(index._points[i]._bits > 7)
+        throw UnZipError("Wrong bits in serialized SeekIndex.");
+      memcpy(&index._windows[i*WINDOW_SIZE], p+17, WINDOW_SIZE);
+    }
+    return index;
+  }
+};
+
+/*
+  Read compressed data ahead by a reader thread with two chunks, so that reading chunk N+1 from File overlaps
+  inflating chunk N. Reader thread starts at the first next() and restarts if consumer moves to other offset.
+*/
+struct ReadPipeline {
+  File& _file;
+
+  const size_t CHUNK_SIZE = 1024*1024;
+
+  std::vector<uint8_t> _chunks[2];
+  size_t _lens[2];
+  bool _ready[2];
+  size_t _consumeIdx = 0; // chunk which consumer takes next.
+  bool _holding = false; // consumer still uses the other chunk.
+  size_t _nextOffset = 0; // file offset of chunk which consumer takes next.
+  bool _running = false;
+  bool _stop = false;
+  std::exception_ptr _error;
+  std::mutex _mutex;
+  std::condition_variable _cv;
+  std::thread _thread;
+
+  ReadPipeline(File& file) : _file(file) {}
+  ReadPipeline(const ReadPipeline&) = delete;
+  ReadPipeline& operator=(const ReadPipeline&) = delete;
+  ~ReadPipeline() { stop(); }
+
+  /*
+    Return chunk of compressed data at offset, left is remaining compressed size from offset. Chunk is valid until next call.
+    Error of reader thread is rethrown here.
+  */
+  const uint8_t* next(size_t offset, size_t left, size_t& len) {
+    if(!_running || offset != _nextOffset) {
+      stop();
+      start(offset, left);
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(_holding) {
+      _ready[1-_consumeIdx] = false;
+      _holding = false;
+      _cv.notify_all();
+    }
+    _cv.wait(lock, [this]() { return _ready[_consumeIdx] || _error; });
+    if(!_ready[_consumeIdx])
+      std::rethrow_exception(_error);
+
+    const uint8_t* data = _chunks[_consumeIdx].data();
+    len = _lens[_consumeIdx];
+    _holding = true;
+    _consumeIdx = 1-_consumeIdx;
+    _nextOffset += len;
+    return data;
+  }
+
+  void stop() {
+    if(!_running)
+      return;
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _cv.notify_all();
+    _thread.join();
+    _running = false;
+  }
+
+private:
+  void start(size_t offset, size_t left) {
+    for(int i = 0; i < 2; i++) {
+      _chunks[i].resize(std::min(CHUNK_SIZE, std::max(left, (size_t)1)));
+      _lens[i] = 0;
+      _ready[i] = false;
+    }
+    _consumeIdx = 0;
+    _holding = false;
+    _nextOffset = offset;
+    _stop = false;
+    _error = nullptr;
+    _thread = std::thread([this, offset, left]() { run(offset, left); });
+    _running = true;
+  }
+
+  void run(size_t offset, size_t left) {
+    for(size_t idx = 0; left != 0; idx = 1-idx) {
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _cv.wait(lock, [this, idx]() { return !_ready[idx] || _stop; });
+        if(_stop)
+          return;
+      }
+      size_t len = std::min(left, CHUNK_SIZE);
+      try {
+        _file.readSpecificSize(offset, _chunks[idx].data(), len, "Can't read enough in CDRContentStream.");
+      } catch(...) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _error = std::current_exception();
+        _cv.notify_all();
+        return;
+      }
+      {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _lens[idx] = len;
+        _ready[idx] = true;
+      }
+      _cv.notify_all();
+      offset += len;
+      left -= len;
+    }
+  }
+};
+
+/*
+  Read entry content chunk by chunk.
+  Compressed data is pulled from File by STREAM_CHUNK_SIZE window and fed to one z_stream,
+  so memory usage does not depend on entry size.
+  With pipelined, compressed data is read ahead by ReadPipeline.
+*/
+struct CDRContentStream {
+  struct ZStreamDeleter {
+    void operator()(z_stream* s) const { inflateEnd(s); delete s; }
+  };
+
+  File* _file;
+  uint16_t _compressionMethod;
+  size_t _dataOffset; // file offset of compressed data start.
+  size_t _compressedSize;
+  size_t _readOffset; // file offset of next compressed data to read.
+  size_t _compressedLeft;
+  size_t _uncompressedSize;
+  size_t _totalOut;
+  bool _finished;
+  bool _verifyCrc;
+  uint32_t _expectedCrc;
+  uint32_t _crc;
+
+  std::vector<uint8_t> _inBuf;
+  // z_stream has back pointer from its internal state, so keep it on heap to make this struct movable.
+  std::unique_ptr<z_stream, ZStreamDeleter> _zs;
+  std::unique_ptr<ReadPipeline> _pipeline;
+
+  const size_t STREAM_CHUNK_SIZE = 64*1024;
+
+  // if verifyCrc is true, read throws UnZipError when read reaches end and crc differs from expectedCrc.
+  CDRContentStream(File& file, uint16_t compressionMethod, size_t offset, size_t compressedSize, size_t uncompressedSize,
+    bool verifyCrc = false, uint32_t expectedCrc = 0, bool pipelined = false) :
+    _file(&file), _compressionMethod(compressionMethod), _dataOffset(offset), _compressedSize(compressedSize), _readOffset(offset), _compressedLeft(compressedSize),
+    _uncompressedSize(uncompressedSize), _totalOut(0), _finished(false), _verifyCrc(verifyCrc), _expectedCrc(expectedCrc), _crc(0) {
+    if(_compressionMethod == 0)
+      return;
+
+    if(_compressionMethod != 8)
+      throw UnZipError("Only stored and deflate entries are supported by stream: method " + std::to_string(_compressionMethod));
+
+    _inBuf.resize(std::min(STREAM_CHUNK_SIZE, std::max(compressedSize, (size_t)1)));
+
+    z_stream* s = new z_stream();
+    s->zalloc = Z_NULL;
+    s->zfree = Z_NULL;
+    s->opaque = Z_NULL;
+    s->avail_in = 0;
+    s->next_in = Z_NULL;
+    if(inflateInit2(s, -15) != Z_OK) {
+      delete s;
+      throw UnZipError("Fail to initialize zlib inflate.");
+    }
+    _zs.reset(s);
+
+    // no I/O to overlap if File supports viewAt.
+    if(pipelined && file.viewAt(offset, compressedSize) == nullptr)
+      _pipeline.reset(new ReadPipeline(file));
+  }
+
+  size_t uncompressedSize() const { return _uncompressedSize; }
+  size_t totalRead() const { return _totalOut; }
+  bool isEnd() const { return _finished || _totalOut == _uncompressedSize; }
+
+  /*
+    Read at most size bytes of uncompressed content to dst.
+    Return read size, 0 means end of content.
+  */
+  size_t read(uint8_t* dst, size_t size) {
+    if(size == 0 || isEnd())
+      return 0;
+
+    size_t len = _compressionMethod == 0 ? readStored(dst, size) : readDeflated(dst, size);
+    if(_verifyCrc) {
+      _crc = UpdateCrc(_crc, dst, len);
+      if(isEnd() && _crc != _expectedCrc)
+        throw UnZipError("CRC-32 mismatch.");
+    }
+    return len;
+  }
+
+  // skip size bytes of content. Return skipped size.
+  size_t skip(size_t size) {
+    if(_compressionMethod == 0) {
+      size_t len = std::min(size, _uncompressedSize - _totalOut);
+      _readOffset += len;
+      _totalOut += len;
+      return len;
+    }
+
+    uint8_t buf[16*1024];
+    size_t total = 0;
+    while(total < size) {
+      size_t len = readDeflated(buf, std::min(sizeof(buf), size-total));
+      if(len == 0)
+        break;
+      total += len;
+    }
+    return total;
+  }
+
+  /*
+    Move read position to uncompressed offset.
+    Inflation restarts from the nearest seek point of index before offset (or from the start if index is nullptr),
+    unless current position is already between the point and offset.
+    CRC verification is disabled after seek because content before offset is not read.
+  */
+  void seek(size_t offset, const SeekIndex* index) {
+    _verifyCrc = false;
+    if(offset > _uncompressedSize)
+      offset = _uncompressedSize;
+
+    if(_compressionMethod == 0) {
+      _readOffset = _dataOffset+offset;
+      _totalOut = offset;
+      return;
+    }
+
+    int pt = (index == nullptr || index->empty()) ? -1 : index->findPoint(offset);
+    uint64_t restartOut = pt == -1 ? 0 : index->_points[pt]._out;
+    if(offset < _totalOut || restartOut > _totalOut)
+      restart(index, pt);
+    skip(offset - _totalOut);
+  }
+
+private:
+  // CDRContentReader::buildSeekIndex drives z_stream directly.
+  template<class> friend struct BasicCDRContentReader;
+
+  void restart(const SeekIndex* index, int pt) {
+    // below reads File directly.
+    if(_pipeline)
+      _pipeline->stop();
+    z_stream& s = *_zs;
+    if(inflateReset(&s) != Z_OK)
+      throw UnZipError("Fail to reset zlib inflate.");
+    s.avail_in = 0;
+    _finished = false;
+
+    if(pt == -1) {
+      _readOffset = _dataOffset;
+      _compressedLeft = _compressedSize;
+      _totalOut = 0;
+      return;
+    }
+
+    const SeekIndex::Point& point = index->_points[pt];
+    if(point._in > _compressedSize || (point._bits != 0 && point._in == 0))
+      throw UnZipError("Wrong seek point.");
+
+    _readOffset = _dataOffset+(size_t)point._in;
+    _compressedLeft = _compressedSize-(size_t)point._in;
+    _totalOut = (size_t)point._out;
+    if(point._bits != 0) {
+      uint8_t b;
+      _file->readSpecificSize(_readOffset-1, &b, 1, "Can't read enough in CDRContentStream.");
+      if(inflatePrime(&s, point._bits, b >> (8-point._bits)) != Z_OK)
+        throw UnZipError("Fail to restore seek point.");
+    }
+    if(point._out != 0 && inflateSetDictionary(&s, index->window(pt), SeekIndex::WINDOW_SIZE) != Z_OK)
+      throw UnZipError("Fail to restore seek point.");
+  }
+
+  void fillInput() {
+    if(_pipeline) {
+      size_t len = 0;
+      const uint8_t* data = _pipeline->next(_readOffset, _compressedLeft, len);
+      _readOffset += len;
+      _compressedLeft -= len;
+      _zs->next_in = (Bytef*)data;
+      _zs->avail_in = (uint32_t)len;
+      return;
+    }
+
+    size_t len = std::min(_compressedLeft, _inBuf.size());
+    const uint8_t* view = _file->viewAt(_readOffset, len);
+    if(view == nullptr) {
+      _file->readSpecificSize(_readOffset, _inBuf.data(), len, "Can't read enough in CDRContentStream.");
+      view = _inBuf.data();
+    }
+    _readOffset += len;
+    _compressedLeft -= len;
+
+    _zs->next_in = (Bytef*)view;
+    _zs->avail_in = (uint32_t)len;
+  }
+
+  size_t readStored(uint8_t* dst, size_t size) {
+    size_t len = std::min(size, _uncompressedSize - _totalOut);
+    _file->readSpecificSize(_readOffset, dst, len, "Can't read enough in CDRContentStream.");
+    _readOffset += len;
+    _totalOut += len;
+    return len;
+  }
+
+  size_t readDeflated(uint8_t* dst, size_t size) {
+    z_stream& s = *_zs;
+    s.next_out = dst;
+    s.avail_out = (uint32_t)std::min(std::min(size, _uncompressedSize - _totalOut), (size_t)1 << 30);
+    size_t requested = s.avail_out;
+#ifdef CPPUNZIP_ENABLE_STATS
+    uLong totalIn = s.total_in;
+#endif
+    StatsTimer timer;
+
+    while(s.avail_out != 0) {
+      // inflate might have pending output even after all input is consumed, so inflate again without input.
+      if(s.avail_in == 0 && _compressedLeft != 0)
+        fillInput();
+
+      int status = inflate(&s, Z_NO_FLUSH);
+      if(status == Z_STREAM_END) {
+        _finished = true;
+        break;
+      }
+      if(status == Z_BUF_ERROR)
+        throw UnZipError("Compressed data ends before deflate stream end.");
+      if(status != Z_OK)
+        throw UnZipError("Fail to inflate: " + std::to_string(status));
+    }
+
+    size_t len = requested - s.avail_out;
+    CPPUNZIP_STATS(*_file, onInflate((size_t)(s.total_in-totalIn), len, timer.elapsed()));
+    _totalOut += len;
+    if(_finished && _totalOut != _uncompressedSize)
+      throw UnZipError("Not enough deflate result.");
+    return len;
+  }
+};
+
+/*
+  Read and uncompress CDRecord entry
+*/
+template<class FileT>
+struct BasicCDRContentReader {
+  FileT& _file;
+  const CDRecord& _entry; // must outlive this reader.
+  size_t _offset; // 0 until resolved, see dataOffset().
+  bool _verifyCrc;
+  bool _speculativeRead;
+  bool _pipelinedRead;
+
+  const size_t LOCAL_FILE_HEADER_SIZE = 30;
+  const size_t CRC_CHUNK = 64*1024;
+  // deflate can't expand more than about 1032:1 (258 bytes match by a few bits), larger uncompressed size is broken.
+  const size_t MAX_DEFLATE_RATIO = 1032;
+  // margin for local extra field larger than central one in speculative read.
+  const size_t SPECULATIVE_MARGIN = 256;
+
+  /*
+    dataOffset is file offset of content if already known, 0 means unknown and it is read from local file header.
+    With options._speculativeRead, reading local file header is deferred and done with raw content by one read.
+  */
+  BasicCDRContentReader(FileT& file, const CDRecord& entry, const ReadOptions& options = ReadOptions(), size_t dataOffset = 0) :
+    _file(file), _entry(entry), _offset(dataOffset), _verifyCrc(options._verifyCrc), _speculativeRead(options._speculativeRead), _pipelinedRead(options._pipelinedRead) {
+    checkUncompressedSize();
+    if(_offset == 0) {
+      if(!_speculativeRead)
+        _offset = readFileContentOffset();
+    }
+    else if(_offset >= _file._size)
+      throw UnZipError("Wrong data offset. File content offset exceeds file size.");
+    else
+      checkCompressedSize(_offset);
+  }
+
+  // entry is referred, not copied, so temporary is not allowed.
+  BasicCDRContentReader(FileT& file, CDRecord&& entry, const ReadOptions& options = ReadOptions(), size_t dataOffset = 0) = delete;
+
+  // file offset of content. Read local file header if not yet resolved.
+  size_t dataOffset() {
+    if(_offset == 0)
+      _offset = readFileContentOffset();
+    return _offset;
+  }
+
+  void checkCrc(uint32_t crc) {
+    if(crc != _entry._crc)
+      throw UnZipError("CRC-32 mismatch: " + _entry._fileName);
+  }
+
+  void checkCrc(const uint8_t* buf, size_t len) {
+    if(_verifyCrc)
+      checkCrc(UpdateCrc(0, buf, len));
+  }
+
+  // copy stored content from view. With crc verification, copy by chunk and update crc while the chunk is in cache.
+  void copyStored(const uint8_t* src, uint8_t* dst, size_t len) {
+    if(!_verifyCrc) {
+      if(len != 0)
+        memcpy(dst, src, len);
+      return;
+    }
+    uint32_t crc = 0;
+    for(size_t pos = 0; pos < len; pos += CRC_CHUNK) {
+      size_t chunk = std::min(CRC_CHUNK, len-pos);
+      memcpy(dst+pos, src+pos, chunk);
+      crc = UpdateCrc(crc, dst+pos, chunk);
+    }
+    checkCrc(crc);
+  }
+
+  void readSpecificSize(size_t offset, uint8_t* dst, size_t size) {
+    ReadSpecificSize(_file, offset, dst, size, "Fail to read expected size in CDRContentReader");
+  }
+
+  size_t readFileContentOffset()
+  {
+    const uint8_t* view = _file.viewAt(_entry._localHeaderOffset, LOCAL_FILE_HEADER_SIZE);
+    if(view != nullptr)
+      return parseLocalFileHeader(view);
+    uint8_t buf[30];
+    readSpecificSize(_entry._localHeaderOffset, buf, LOCAL_FILE_HEADER_SIZE);
+    return parseLocalFileHeader(buf);
+  }
+
+  // buf must point LOCAL_FILE_HEADER_SIZE bytes at local header offset. Return file offset of content.
+  size_t parseLocalFileHeader(const uint8_t* buf) {
+    if (buf[0] != 0x50 || buf[1] != 0x4b || buf[2] != 0x03 || buf[3] != 0x04)
+      throw UnZipError("Local File header signature does not match.");
+
+    uint16_t fnameLen = Read2Byte(buf, 26);
+    uint16_t exFieldLen = Read2Byte(buf, 28);
+
+    size_t offset = _entry._localHeaderOffset+LOCAL_FILE_HEADER_SIZE+fnameLen+exFieldLen;
+
+    if(offset >= _file._size)
+      throw UnZipError("Wrong local file header. File content offset exceeds file size.");
+    checkCompressedSize(offset);
+
+    return offset;
+  }
+
+  // sizes are from central directory (64bit with Zip64), so check them before they are used for allocation.
+  void checkCompressedSize(size_t offset) const {
+    if(compressedSize() > _file._size - offset)
+      throw UnZipError("Wrong compressed size. Content exceeds file size: " + _entry._fileName);
+  }
+
+  void checkUncompressedSize() const {
+    if(compressionMethod() == 8 && uncompressedSize()/MAX_DEFLATE_RATIO > compressedSize())
+      throw UnZipError("Wrong uncompressed size. Exceeds maximum deflate ratio: " + _entry._fileName);
+    if(uncompressedSize() > std::vector<uint8_t>().max_size())
+      throw UnZipError("Wrong uncompressed size. Too large: " + _entry._fileName);
+  }
+
+  size_t uncompressedSize() const { return _entry._uncompressedSize; }
+  size_t compressedSize() const { return _entry._compressedSize; }
+  uint16_t compressionMethod() const { return _entry._compressionMethod; }
+
+  void readRawContent(uint8_t* dst, size_t size) {
+    if(size != compressedSize())
+      throw UnZipError("dst buffer size and compressed size differs.");
+    
+    size_t len = _file.readAt(dataOffset(), dst, size);
+    if(len != size)
+      throw UnZipError("Can't read enough in readRawContent.");
+  }
+
+  bool useSpeculativeRead() const { return _speculativeRead && _offset == 0; }
+
+  /*
+    Read local file header and raw content by one read (two reads if local header is larger than estimated),
+    and return pointer to raw content in buf. If File supports viewAt, buf is not used.
+  */
+  const uint8_t* readSpeculative(std::vector<uint8_t>& buf) {
+    size_t headerOffset = _entry._localHeaderOffset;
+    if(_file.viewAt(headerOffset, LOCAL_FILE_HEADER_SIZE) != nullptr) {
+      dataOffset();
+      return viewRawContent();
+    }
+    buf.resize(speculativeSize());
+    size_t len = _file.readAt(headerOffset, buf.data(), buf.size());
+    return completeSpeculative(buf, len);
+  }
+
+  // estimated size of local file header and raw content, read from local header offset.
+  size_t speculativeSize() const {
+    size_t headerOffset = _entry._localHeaderOffset;
+    if(headerOffset >= _file._size)
+      throw UnZipError("Wrong local header offset. Exceeds file size.");
+
+    size_t estimate = LOCAL_FILE_HEADER_SIZE+_entry._fileNameLength+_entry._extraFieldLength+compressedSize()+SPECULATIVE_MARGIN;
+    return std::min(estimate, _file._size-headerOffset);
+  }
+
+  /*
+    buf holds len bytes read from local header offset. Parse local file header, read the rest if local header is larger
+    than estimated, and return pointer to raw content in buf.
+  */
+  const uint8_t* completeSpeculative(std::vector<uint8_t>& buf, size_t len) {
+    size_t headerOffset = _entry._localHeaderOffset;
+    if(len < LOCAL_FILE_HEADER_SIZE)
+      throw UnZipError("Fail to read expected size in CDRContentReader");
+
+    _offset = parseLocalFileHeader(buf.data());
+    size_t start = _offset-headerOffset;
+    if(start+compressedSize() > len) {
+      // local extra field is larger than estimated, read the rest.
+      size_t from = std::max(len, start);
+      buf.resize(start+compressedSize());
+      readSpecificSize(headerOffset+from, buf.data()+from, start+compressedSize()-from);
+    }
+    return buf.data()+start;
+  }
+
+  /*
+    Same as above, but buf is fixed speculativeSize() bytes (like scratch buffer) and can't grow.
+    If local header is larger than estimated, raw content is read again to the head of buf.
+    buf is large enough for it because compressed size is checked against file size.
+  */
+  const uint8_t* completeSpeculative(uint8_t* buf, size_t len) {
+    if(len < LOCAL_FILE_HEADER_SIZE)
+      throw UnZipError("Fail to read expected size in CDRContentReader");
+
+    _offset = parseLocalFileHeader(buf);
+    size_t start = _offset-_entry._localHeaderOffset;
+    if(start+compressedSize() <= len)
+      return buf+start;
+    readRawContent(buf, compressedSize());
+    return buf;
+  }
+
+  std::vector<uint8_t> readRawContent() {
+    checkStoredSize();
+    if(useSpeculativeRead()) {
+      std::vector<uint8_t> buf;
+      const uint8_t* raw = readSpeculative(buf);
+      if(buf.empty())
+        return std::vector<uint8_t>(raw, raw+compressedSize());
+      buf.erase(buf.begin(), buf.begin()+(raw-buf.data()));
+      buf.resize(compressedSize());
+      return buf;
+    }
+
+    const uint8_t* view = viewRawContent();
+    if(view != nullptr)
+      return std::vector<uint8_t>(view, view+compressedSize());
+
+    std::vector<uint8_t> buf(compressedSize());
+
+    readRawContent(buf.data(), compressedSize());
+    return buf;
+  }
+
+  /*
+    Return pointer to raw content if File supports viewAt, otherwise nullptr.
+  */
+  const uint8_t* viewRawContent() {
+    return _file.viewAt(dataOffset(), compressedSize());
+  }
+
+  // throw UnZipError if compression method is neither stored nor registered to DecoderRegistry.
+  void checkMethod() const {
+    if(!DecoderRegistry::Default().supports(compressionMethod()))
+      throw UnZipError("Unsupported compression method: " + std::to_string(compressionMethod()));
+    checkStoredSize();
+  }
+
+  // stored content is copied by compressedSize() into uncompressedSize() buffer, so broken central directory must not reach there.
+  void checkStoredSize() const {
+    if(compressionMethod() == 0 && compressedSize() != uncompressedSize())
+      throw UnZipError("Compressed size and uncompressed size of stored entry differ: " + _entry._fileName);
+  }
+
+  void decompressRawContent(const uint8_t* srcBuf, size_t srcSize, uint8_t* dstBuf, size_t dstSize) {
+    if(compressionMethod() == 0)
+      throw UnZipError("File is uncompressed, no need to call decompressRawContent");
+    
+    Decoder* decoder = DecoderRegistry::Default().find(compressionMethod());
+    if(decoder == nullptr)
+      throw UnZipError("Unsupported compression method: " + std::to_string(compressionMethod()));
+
+    if((srcSize < compressedSize()) || (dstSize < uncompressedSize()))
+      throw UnZipError("srcSize or dstSize of decompressRawContent mismatch.");
+    
+    StatsTimer timer;
+    if(!_verifyCrc) {
+      decoder->decode(srcBuf, compressedSize(), dstBuf, uncompressedSize(), nullptr);
+    } else {
+      uint32_t crc = 0;
+      decoder->decode(srcBuf, compressedSize(), dstBuf, uncompressedSize(), &crc);
+      checkCrc(crc);
+    }
+    CPPUNZIP_STATS(_file, onInflate(compressedSize(), uncompressedSize(), timer.elapsed()));
+  }
+
+  void notifyEntryRead() {
+    CPPUNZIP_STATS(_file, onEntryRead(_entry._fileName, _entry._compressedSize, _entry._uncompressedSize));
+  }
+
+  /*
+    read entry file content and inflate if necessary (if no compression, just return raw content)
+  */
+  std::vector<uint8_t> readContent() {
+    checkMethod();
+
+    if(usePipeline()) {
+      notifyEntryRead();
+      std::vector<uint8_t> content(uncompressedSize());
+      readPipelined(content.data());
+      return content;
+    }
+
+    std::vector<uint8_t> buf;
+    const uint8_t* view = useSpeculativeRead() ? readSpeculative(buf) : viewRawContent();
+    if(view != nullptr)
+      return decompressContent(view);
+
+    return decompressContent(readRawContent());
+  }
+
+  // inflate (or copy if no compression) raw content of compressedSize() bytes at rawContent. Does not touch File.
+  std::vector<uint8_t> decompressContent(const uint8_t* rawContent) {
+    checkStoredSize();
+    notifyEntryRead();
+    if(compressionMethod() == 0) {
+      std::vector<uint8_t> content(compressedSize());
+      copyStored(rawContent, content.data(), content.size());
+      return content;
+    }
+
+    std::vector<uint8_t> uncompressedBuf(uncompressedSize());
+    decompressRawContent(rawContent, compressedSize(), uncompressedBuf.data(), uncompressedSize());
+    return uncompressedBuf;
+  }
+
+  /*
+    inflate the result of readRawContent if necessary (if no compression, just return raw content)
+    Does not touch File, so it can be called after releasing lock of File.
+  */
+  std::vector<uint8_t> decompressContent(std::vector<uint8_t> rawContent) {
+    checkStoredSize();
+    notifyEntryRead();
+    if(compressionMethod() == 0) {
+      checkCrc(rawContent.data(), rawContent.size());
+      return rawContent;
+    }
+
+    std::vector<uint8_t> uncompressedBuf(uncompressedSize());
+    decompressRawContent(rawContent.data(), rawContent.size(), uncompressedBuf.data(), uncompressedSize());
+    return uncompressedBuf;
+  }
+
+  /*
+    read entry file content to dst and inflate if necessary, return content size.
+    Compressed data is inflated directly from File if it supports viewAt,
+    otherwise it is read to temporary buffer from scratch (or std::vector if scratch is nullptr).
+    With speculative read, local file header is read together with compressed data into the temporary buffer.
+  */
+  size_t readContentInto(uint8_t* dst, size_t dstSize, ScratchAllocator* scratch) {
+    checkMethod();
+    if(dstSize < uncompressedSize())
+      throw UnZipError("dst buffer is smaller than uncompressed size.");
+
+    struct ScratchHolder {
+      ScratchAllocator* _allocator;
+      std::vector<uint8_t> _vec;
+      uint8_t* _ptr;
+      size_t _size;
+      ScratchHolder(ScratchAllocator* allocator, size_t size) : _allocator(allocator), _ptr(nullptr), _size(size) {
+        if(_allocator != nullptr) {
+          _ptr = _allocator->allocate(size);
+        } else {
+          _vec.resize(size);
+          _ptr = _vec.data();
+        }
+      }
+      ~ScratchHolder() {
+        if(_allocator != nullptr)
+          _allocator->deallocate(_ptr, _size);
+      }
+    };
+
+    notifyEntryRead();
+    // same priority as readContent: pipelined deflate resolves local header first.
+    if(useSpeculativeRead() && !(_pipelinedRead && compressionMethod() == 8)
+       && _file.viewAt(_entry._localHeaderOffset, LOCAL_FILE_HEADER_SIZE) == nullptr) {
+      ScratchHolder holder(scratch, speculativeSize());
+      size_t len = _file.readAt(_entry._localHeaderOffset, holder._ptr, holder._size);
+      const uint8_t* raw = completeSpeculative(holder._ptr, len);
+      if(compressionMethod() == 0)
+        copyStored(raw, dst, compressedSize());
+      else
+        decompressRawContent(raw, compressedSize(), dst, uncompressedSize());
+      return uncompressedSize();
+    }
+
+    if(compressionMethod() == 0) {
+      const uint8_t* view = viewRawContent();
+      if(view != nullptr) {
+        copyStored(view, dst, compressedSize());
+      } else {
+        readRawContent(dst, compressedSize());
+        checkCrc(dst, compressedSize());
+      }
+      return uncompressedSize();
+    }
+
+    const uint8_t* view = viewRawContent();
+    if(view != nullptr) {
+      decompressRawContent(view, compressedSize(), dst, uncompressedSize());
+      return uncompressedSize();
+    }
+
+    if(usePipeline()) {
+      readPipelined(dst);
+      return uncompressedSize();
+    }
+
+    ScratchHolder holder(scratch, compressedSize());
+    readRawContent(holder._ptr, compressedSize());
+    decompressRawContent(holder._ptr, compressedSize(), dst, uncompressedSize());
+    return uncompressedSize();
+  }
+
+  /*
+    Inflate whole content once and record seek point at deflate block boundary every span bytes of output.
+    Stored entry does not need seek point, so returned index is empty.
+  */
+  SeekIndex buildSeekIndex(size_t span) {
+    if(compressionMethod() != 0 && compressionMethod() != 8)
+      throw UnZipError("Only stored and deflate entries are supported by seek index: method " + std::to_string(compressionMethod()));
+
+    SeekIndex index;
+    index._compressedSize = compressedSize();
+    index._uncompressedSize = uncompressedSize();
+    index._crc = _entry._crc;
+    index._span = span;
+    if(compressionMethod() == 0)
+      return index;
+
+    CDRContentStream stream = openStream();
+    z_stream& s = *stream._zs;
+    std::vector<uint8_t> window(SeekIndex::WINDOW_SIZE);
+    size_t totalIn = 0;
+    size_t totalOut = 0;
+    size_t last = 0;
+    int status = Z_OK;
+    s.avail_out = 0;
+
+    while(status != Z_STREAM_END) {
+      // Z_BLOCK stops before stream end after the last block, so inflate again even without input.
+      // Truncated data results in Z_BUF_ERROR.
+      if(s.avail_in == 0 && stream._compressedLeft != 0)
+        stream.fillInput();
+      if(s.avail_out == 0) {
+        s.avail_out = SeekIndex::WINDOW_SIZE;
+        s.next_out = window.data();
+      }
+
+      // inflate until end of deflate block.
+      size_t availIn = s.avail_in;
+      size_t availOut = s.avail_out;
+      status = inflate(&s, Z_BLOCK);
+      totalIn += availIn - s.avail_in;
+      totalOut += availOut - s.avail_out;
+      if(status != Z_OK && status != Z_STREAM_END)
+        throw UnZipError("Fail to inflate: " + std::to_string(status));
+      if(totalOut > uncompressedSize())
+        throw UnZipError("Deflate result exceeds uncompressed size.");
+
+      // bit 7: end of block, bit 6: last block.
+      bool atBoundary = (s.data_type & 128) && !(s.data_type & 64);
+      if(atBoundary && (totalOut == 0 || totalOut - last > span)) {
+        SeekIndex::Point point;
+        point._out = totalOut;
+        point._in = totalIn;
+        point._bits = (uint8_t)(s.data_type & 7);
+        index._points.push_back(point);
+
+        // window is ring buffer, make it linear.
+        size_t left = s.avail_out;
+        size_t base = index._windows.size();
+        index._windows.resize(base+SeekIndex::WINDOW_SIZE);
+        if(left != 0)
+          memcpy(&index._windows[base], window.data()+SeekIndex::WINDOW_SIZE-left, left);
+        if(left < SeekIndex::WINDOW_SIZE)
+          memcpy(&index._windows[base+left], window.data(), SeekIndex::WINDOW_SIZE-left);
+        last = totalOut;
+      }
+    }
+    if(totalOut != uncompressedSize())
+      throw UnZipError("Not enough deflate result.");
+    return index;
+  }
+
+  /*
+    Read len bytes from uncompressed offset to dst, return read size (shorter at content end).
+    Inflation starts from the nearest seek point of index if specified, otherwise from the start of content.
+  */
+  size_t readRange(size_t offset, uint8_t* dst, size_t len, const SeekIndex* index) {
+    if(index != nullptr && !index->isFor(_entry))
+      throw UnZipError("SeekIndex is not built for this entry.");
+    if(offset >= uncompressedSize())
+      return 0;
+
+    CDRContentStream stream = openStream();
+    stream.seek(offset, index);
+    size_t total = 0;
+    while(total < len) {
+      size_t res = stream.read(dst+total, len-total);
+      if(res == 0)
+        break;
+      total += res;
+    }
+    return total;
+  }
+
+  /*
+    Inflate whole content to dst by threadNum threads (0 means hardware concurrency). dstSize must be at least uncompressedSize().
+    Spans between seek points of index are independent, so each thread restarts inflation from a point and decodes its span.
+    Speed up is bounded by the number of points, so build index with span of about uncompressedSize/(threads*4) or smaller.
+    If File does not supportsConcurrentRead, spans are decoded by one thread.
+  */
+  size_t readContentParallel(uint8_t* dst, size_t dstSize, const SeekIndex& index, size_t threadNum) {
+    if(dstSize < uncompressedSize())
+      throw UnZipError("dst buffer is smaller than uncompressed size.");
+    if(compressionMethod() != 8 || index.empty())
+      return readContentInto(dst, dstSize, nullptr);
+    if(!index.isFor(_entry))
+      throw UnZipError("SeekIndex is not built for this entry.");
+
+    notifyEntryRead();
+    // span i is [start(i), start(i+1)), span 0 starts from the content start.
+    size_t spanNum = index.size()+1;
+    auto start = [&](size_t i) -> size_t { return i == 0 ? 0 : (i == spanNum ? uncompressedSize() : (size_t)index._points[i-1]._out); };
+    std::vector<uint32_t> crcs(spanNum, 0);
+
+    if(threadNum == 0)
+      threadNum = std::max(std::thread::hardware_concurrency(), 1u);
+    if(!_file.supportsConcurrentRead())
+      threadNum = 1;
+    threadNum = std::min(threadNum, spanNum);
+
+    // resolve before workers because dataOffset() might read File.
+    size_t offset = dataOffset();
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::mutex errorMutex;
+    std::exception_ptr error;
+
+    auto worker = [&]() {
+      try {
+        while(!failed) {
+          size_t i = next++;
+          if(i >= spanNum)
+            return;
+          size_t from = start(i);
+          size_t len = start(i+1) - from;
+          if(len == 0)
+            continue;
+
+          CDRContentStream stream(_file, compressionMethod(), offset, compressedSize(), uncompressedSize());
+          stream.seek(from, &index);
+          size_t total = 0;
+          while(total < len) {
+            size_t res = stream.read(dst+from+total, len-total);
+            if(res == 0)
+              throw UnZipError("Not enough deflate result.");
+            total += res;
+          }
+          if(_verifyCrc)
+            crcs[i] = UpdateCrc(0, dst+from, len);
+        }
+      } catch(...) {
+        std::lock_guard<std::mutex> lock(errorMutex);
+        if(!error)
+          error = std::current_exception();
+        failed = true;
+      }
+    };
+
+    if(threadNum <= 1) {
+      worker();
+    } else {
+      std::vector<std::thread> threads;
+      for(size_t i = 0; i < threadNum; i++)
+        threads.push_back(std::thread(worker));
+      for(auto& t : threads)
+        t.join();
+    }
+    if(error)
+      std::rethrow_exception(error);
+
+    if(_verifyCrc) {
+      uint32_t crc = 0;
+      for(size_t i = 0; i < spanNum; i++)
+        crc = (uint32_t)crc32_combine(crc, crcs[i], (z_off_t)(start(i+1)-start(i)));
+      checkCrc(crc);
+    }
+    return uncompressedSize();
+  }
+
+  /*
+    open entry content as a stream instead of reading whole content at once.
+  */
+  CDRContentStream openStream() {
+    checkStoredSize();
+    return CDRContentStream(_file, compressionMethod(), dataOffset(), compressedSize(), uncompressedSize(), _verifyCrc, _entry._crc, _pipelinedRead);
+  }
+
+  // true if content should be inflated by pipelined stream instead of reading whole raw content first.
+  bool usePipeline() {
+    return _pipelinedRead && compressionMethod() == 8 && viewRawContent() == nullptr;
+  }
+
+  // inflate whole content to dst by pipelined stream.
+  void readPipelined(uint8_t* dst) {
+    CDRContentStream stream = openStream();
+    size_t total = 0;
+    while(total < uncompressedSize()) {
+      size_t len = stream.read(dst+total, uncompressedSize()-total);
+      if(len == 0)
+        throw UnZipError("Not enough deflate result.");
+      total += len;
+    }
+  }
+
+};
+
+typedef BasicCDRContentReader<File> CDRContentReader;
+
+/*
+  Entry point.
+*/
+template<class FileT>
+struct BasicEOCDRReader {
+  FileT& _file;
+
+  const size_t EOCDR_SIZE = 22; // comment is variable length, so real size is this size plus comment len.
+
+  BasicEOCDRReader(FileT& zipFile) : _file(zipFile) {}
+
+
+
+  bool isEndOfCDR(const uint8_t* buf, size_t len, size_t pos) const {
+    if(buf[pos+0] == 0x50 && buf[pos+1] == 0x4b && buf[pos+2] == 0x05 && buf[pos+3] == 0x06) {
+      size_t commentLen = Read2Byte(buf, pos+EOCDR_SIZE-2);
+      return pos+EOCDR_SIZE+commentLen <= len;
+    }
+    return false;
+  }
+
+#ifdef CPPUNZIP_SSE2
+  static int HighestBit(unsigned mask) {
+#ifdef _MSC_VER
+    unsigned long idx;
+    _BitScanReverse(&idx, mask);
+    return (int)idx;
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+  }
+#endif
+
+  // find 0x06054b50 backward, also check comment len is inside buffer.
+  // First byte 0x50 is searched by 16 bytes at once with SSE2 or NEON.
+  // if not found, return -1.
+  int findEndOfCDRInBlock(const uint8_t* buf, size_t len) {
+    if(len < EOCDR_SIZE)
+      return -1;
+    int pos = (int)(len-EOCDR_SIZE);
+
+#if defined(CPPUNZIP_SSE2)
+    const __m128i sig = _mm_set1_epi8(0x50);
+    for(; pos >= 15; pos -= 16) {
+      int base = pos-15;
+      unsigned mask = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(buf+base)), sig));
+      while(mask != 0) {
+        int bit = HighestBit(mask);
+        if(isEndOfCDR(buf, len, base+bit))
+          return base+bit;
+        mask &= ~(1u << bit);
+      }
+    }
+#elif defined(CPPUNZIP_NEON)
+    const uint8x16_t sig = vdupq_n_u8(0x50);
+    for(; pos >= 15; pos -= 16) {
+      int base = pos-15;
+      if(vmaxvq_u8(vceqq_u8(vld1q_u8(buf+base), sig)) == 0)
+        continue;
+      for(int i = pos; i >= base; i--) {
+        if(isEndOfCDR(buf, len, i))
+          return i;
       }
     }
+#endif
+
+    for(; pos >= 0; pos--) {
+      if(isEndOfCDR(buf, len, pos))
+        return pos;
+    }
     return -1;
   }
 
   EOCDRecord readEOCDRecord() {
     // go reader first check 1024, and if not found, check 65k. I use the same strategy.
-    size_t bufLens[] = {1024, 65*1024};
+    // The second block includes the first block, so read only the rest for the second.
+    const size_t FIRST_BLOCK = 1024;
+    const size_t SECOND_BLOCK = 65*1024;
 
-    for(int i = 0; i < 2; i++) {
-      size_t bufSize = bufLens[i];
-      std::vector<uint8_t> buf(bufSize);
+    if (_file._size <= EOCDR_SIZE)
+      throw UnZipError("Can't read enough size for End of Central Directory Record. Too small file or read error.");
+
+    size_t secondLen = std::min(SECOND_BLOCK, _file._size);
+    size_t firstLen = std::min(FIRST_BLOCK, secondLen);
+    size_t origin = _file._size - secondLen;
+
+    std::vector<uint8_t> buf;
+    const uint8_t* block = _file.viewAt(origin, secondLen);
+    // block[validFrom, secondLen) holds file content.
+    size_t validFrom = 0;
+    if(block == nullptr) {
+      buf.resize(secondLen);
+      ReadSpecificSize(_file, _file._size-firstLen, buf.data()+secondLen-firstLen, firstLen,
+        "Can't read enough size for End of Central Directory Record. Too small file or read error.");
+      block = buf.data();
+      validFrom = secondLen-firstLen;
+    }
+
+    int sigPos = findEndOfCDRInBlock(block+secondLen-firstLen, firstLen);
+    if(sigPos != -1) {
+      sigPos += (int)(secondLen-firstLen);
+    } else if(secondLen > firstLen) {
+      if(!buf.empty())
+        ReadSpecificSize(_file, origin, buf.data(), secondLen-firstLen,
+          "Can't read enough size for End of Central Directory Record. Too small file or read error.");
+      validFrom = 0;
+      sigPos = findEndOfCDRInBlock(block, secondLen);
+    }
+    if (sigPos == -1)
+      throw UnZipError("Can't find End of Central Directory Record. Corrupted zip file.");
+
+    const uint8_t* eocdrBuf = block+sigPos;
+
+    EOCDRecord eocd( Read2Byte(eocdrBuf, 10), Read4Byte(eocdrBuf, 12), Read4Byte(eocdrBuf, 16) );
+    eocd._eocdOffset = origin+sigPos;
+    // Zip64 locator just before EOCDR is usually in the block already read.
+    const uint8_t* locator = (size_t)sigPos >= validFrom+ZIP64_LOCATOR_SIZE ? eocdrBuf-ZIP64_LOCATOR_SIZE : nullptr;
+    readZip64EOCDRecord(origin+sigPos, locator, eocd);
+    return eocd;
+  }
+
+  const size_t ZIP64_LOCATOR_SIZE = 20;
+  const size_t ZIP64_EOCDR_SIZE = 56; // except for extensible data sector.
+
+  /*
+    If Zip64 end of central directory locator(4.3.15 in spec) exists just before EOCDR,
+    overwrite eocd by Zip64 end of central directory record(4.3.14 in spec).
+    locator points ZIP64_LOCATOR_SIZE bytes before EOCDR if already in memory, otherwise nullptr and it is read from File.
+  */
+  void readZip64EOCDRecord(size_t eocdrPos, const uint8_t* locator, EOCDRecord& eocd) {
+    if(eocdrPos < ZIP64_LOCATOR_SIZE)
+      return;
+
+    uint8_t locatorBuf[20];
+    if(locator == nullptr) {
+      ReadSpecificSize(_file, eocdrPos-ZIP64_LOCATOR_SIZE, locatorBuf, ZIP64_LOCATOR_SIZE, "Fail to read Zip64 end of central directory locator.");
+      locator = locatorBuf;
+    }
+    if(locator[0] != 0x50 || locator[1] != 0x4b || locator[2] != 0x06 || locator[3] != 0x07)
+      return;
+
+    uint64_t recPos = Read8Byte(locator, 8);
+    if(recPos > eocdrPos-ZIP64_LOCATOR_SIZE)
+      throw UnZipError("Wrong Zip64 end of central directory locator.");
+
+    uint8_t rec[56];
+    ReadSpecificSize(_file, (size_t)recPos, rec, ZIP64_EOCDR_SIZE, "Fail to read Zip64 end of central directory record.");
+    if(rec[0] != 0x50 || rec[1] != 0x4b || rec[2] != 0x06 || rec[3] != 0x06)
+      throw UnZipError("Zip64 end of central directory record signature does not match.");
+
+    eocd._cdEntryNum = Read8Byte(rec, 32);
+    eocd._cdSize = Read8Byte(rec, 40);
+    eocd._cdOffset = Read8Byte(rec, 48);
+  }
+  
+};
+
+typedef BasicEOCDRReader<File> EOCDRReader;
+
+
+/*
+  Compact table of central directory for lookup by file name.
+  Entries are stored in one vector, names are stored in one contiguous arena,
+  and name lookup uses open addressing hash table of entry index.
+  Extra field and comment are not kept.
+*/
+struct EntryIndex {
+  struct Entry {
+    uint32_t _nameHash;
+    uint32_t _nameOffset; // offset in _names arena
+    uint16_t _fileNameLength;
+    uint16_t _flags;
+    uint16_t _compressionMethod;
+    uint16_t _lastModTime;
+    uint16_t _lastModDate;
+    uint16_t _internalFileAttrs;
+    uint32_t _externalFileAttrs;
+    uint32_t _crc;
+    uint64_t _compressedSize;
+    uint64_t _uncompressedSize;
+    uint64_t _localHeaderOffset;
+    uint64_t _dataOffset; // file offset of content. 0 means not yet resolved.
+  };
+
+  std::vector<Entry> _entries;
+  std::string _names;
+  // entry index + 1, 0 means empty slot. size is power of 2.
+  std::vector<uint32_t> _buckets;
+
+  // FNV-1a
+  static uint32_t HashName(const char* name, size_t len) {
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < len; i++) {
+      h ^= (uint8_t)name[i];
+      h *= 16777619u;
+    }
+    return h;
+  }
+
+  size_t size() const { return _entries.size(); }
+  bool empty() const { return _entries.empty(); }
+
+  template<class FileT>
+  void build(FileT& file, const EOCDRecord& eocd) {
+    _entries.clear();
+    _names.clear();
+    // entry num might be corrupted, so do not trust it more than central directory size.
+    _entries.reserve((size_t)std::min(eocd._cdEntryNum, eocd._cdSize/46));
+
+    BasicBulkCDReader<FileT> reader(file, eocd);
+    while(!reader.isEnd()) {
+      CDRecordView rec = reader.readOne();
+      add(rec, rec._fileName);
+    }
+
+    buildBuckets();
+  }
+
+  void add(const CDHeader& rec, const char* fileName) {
+    Entry ent;
+    ent._nameHash = HashName(fileName, rec._fileNameLength);
+    ent._nameOffset = (uint32_t)_names.size();
+    ent._fileNameLength = rec._fileNameLength;
+    ent._flags = rec._flags;
+    ent._compressionMethod = rec._compressionMethod;
+    ent._lastModTime = rec._lastModTime;
+    ent._lastModDate = rec._lastModDate;
+    ent._internalFileAttrs = rec._internalFileAttrs;
+    ent._externalFileAttrs = rec._externalFileAttrs;
+    ent._crc = rec._crc;
+    ent._compressedSize = rec._compressedSize;
+    ent._uncompressedSize = rec._uncompressedSize;
+    ent._localHeaderOffset = rec._localHeaderOffset;
+    ent._dataOffset = 0;
+    _names.append(fileName, rec._fileNameLength);
+    _entries.push_back(ent);
+  }
+
+  void buildBuckets() {
+    size_t bucketNum = 16;
+    while(bucketNum < _entries.size()*2)
+      bucketNum *= 2;
+    _buckets.assign(bucketNum, 0);
+
+    size_t mask = bucketNum-1;
+    for(size_t i = 0; i < _entries.size(); i++) {
+      size_t pos = _entries[i]._nameHash & mask;
+      while(_buckets[pos] != 0)
+        pos = (pos+1) & mask;
+      _buckets[pos] = (uint32_t)(i+1);
+    }
+  }
+
+  bool nameEquals(const Entry& ent, const char* name, size_t len) const {
+    return ent._fileNameLength == len && _names.compare(ent._nameOffset, len, name, len) == 0;
+  }
+
+  // return -1 if not found. If the same name appears twice, the first one is returned.
+  int indexOf(const char* name, size_t len) const {
+    if(_buckets.empty())
+      return -1;
+
+    uint32_t h = HashName(name, len);
+    size_t mask = _buckets.size()-1;
+    for(size_t pos = h & mask; _buckets[pos] != 0; pos = (pos+1) & mask) {
+      const Entry& ent = _entries[_buckets[pos]-1];
+      if(ent._nameHash == h && nameEquals(ent, name, len))
+        return (int)(_buckets[pos]-1);
+    }
+    return -1;
+  }
 
-      size_t origin = _file._size > bufSize ? _file._size - bufSize : 0;
+  // read local file header of all non-directory entries to fill _dataOffset.
+  template<class FileT>
+  void resolveDataOffsets(FileT& file) {
+    CDRecord rec;
+    for(size_t i = 0; i < _entries.size(); i++) {
+      if(_entries[i]._dataOffset != 0 || isDir(i))
+        continue;
+      toRecord(i, rec);
+      BasicCDRContentReader<FileT> reader(file, rec);
+      _entries[i]._dataOffset = reader._offset;
+    }
+  }
+
+  enum { ENTRY_SIZE = 60 };
+
+  void serialize(std::vector<uint8_t>& buf) const {
+    Write8Byte(buf, _entries.size());
+    Write8Byte(buf, _names.size());
+    for(size_t i = 0; i < _entries.size(); i++) {
+      const Entry& ent = _entries[i];
+      Write4Byte(buf, ent._nameHash);
+      Write4Byte(buf, ent._nameOffset);
+      Write2Byte(buf, ent._fileNameLength);
+      Write2Byte(buf, ent._flags);
+      Write2Byte(buf, ent._compressionMethod);
+      Write2Byte(buf, ent._lastModTime);
+      Write2Byte(buf, ent._lastModDate);
+      Write2Byte(buf, ent._internalFileAttrs);
+      Write4Byte(buf, ent._externalFileAttrs);
+      Write4Byte(buf, ent._crc);
+      Write8Byte(buf, ent._compressedSize);
+      Write8Byte(buf, ent._uncompressedSize);
+      Write8Byte(buf, ent._localHeaderOffset);
+      Write8Byte(buf, ent._dataOffset);
+    }
+    buf.insert(buf.end(), _names.begin(), _names.end());
+  }
+
+  // return false if data is broken.
+  // Hash table is not serialized but rebuilt, so broken data can't make indexOf probe forever.
+  bool deserialize(const uint8_t* data, size_t size) {
+    if(size < 16)
+      return false;
+    uint64_t entryNum = Read8Byte(data, 0);
+    uint64_t namesSize = Read8Byte(data, 8);
+    size_t pos = 16;
+    if(entryNum > (size-pos)/ENTRY_SIZE)
+      return false;
+    size_t entriesEnd = pos+(size_t)entryNum*ENTRY_SIZE;
+    if(namesSize != size-entriesEnd)
+      return false;
+
+    _entries.resize((size_t)entryNum);
+    for(size_t i = 0; i < _entries.size(); i++, pos += ENTRY_SIZE) {
+      Entry& ent = _entries[i];
+      const uint8_t* p = data+pos;
+      ent._nameHash = Read4Byte(p, 0);
+      ent._nameOffset = Read4Byte(p, 4);
+      ent._fileNameLength = Read2Byte(p, 8);
+      ent._flags = Read2Byte(p, 10);
+      ent._compressionMethod = Read2Byte(p, 12);
+      ent._lastModTime = Read2Byte(p, 14);
+      ent._lastModDate = Read2Byte(p, 16);
+      ent._internalFileAttrs = Read2Byte(p, 18);
+      ent._externalFileAttrs = Read4Byte(p, 20);
+      ent._crc = Read4Byte(p, 24);
+      ent._compressedSize = Read8Byte(p, 28);
+      ent._uncompressedSize = Read8Byte(p, 36);
+      ent._localHeaderOffset = Read8Byte(p, 44);
+      ent._dataOffset = Read8Byte(p, 52);
+      if((uint64_t)ent._nameOffset+ent._fileNameLength > namesSize)
+        return false;
+    }
+    _names.assign((const char*)data+pos, (size_t)namesSize);
+    buildBuckets();
+    return true;
+  }
+
+  bool isDir(size_t idx) const {
+    const Entry& ent = _entries[idx];
+    return ent._fileNameLength != 0 && _names[ent._nameOffset+ent._fileNameLength-1] == '/';
+  }
+
+  std::string fileName(size_t idx) const {
+    const Entry& ent = _entries[idx];
+    return _names.substr(ent._nameOffset, ent._fileNameLength);
+  }
+
+  CDRecord toRecord(size_t idx) const {
+    CDRecord rec;
+    toRecord(idx, rec);
+    return rec;
+  }
+
+  // fill rec by entry idx, reusing buffers of rec.
+  void toRecord(size_t idx, CDRecord& rec) const {
+    const Entry& ent = _entries[idx];
+    rec._flags = ent._flags;
+    rec._compressionMethod = ent._compressionMethod;
+    rec._lastModTime = ent._lastModTime;
+    rec._lastModDate = ent._lastModDate;
+    rec._crc = ent._crc;
+    rec._compressedSize = ent._compressedSize;
+    rec._uncompressedSize = ent._uncompressedSize;
+    rec._fileNameLength = ent._fileNameLength;
+    rec._extraFieldLength = 0;
+    rec._commentLength = 0;
+    rec._internalFileAttrs = ent._internalFileAttrs;
+    rec._externalFileAttrs = ent._externalFileAttrs;
+    rec._localHeaderOffset = ent._localHeaderOffset;
+    rec._fileName.assign(_names.data()+ent._nameOffset, ent._fileNameLength);
+    rec._extraField.clear();
+    rec._comment.clear();
+  }
+};
+
+/*
+  Directory tree of EntryIndex by path component.
+  All nodes are in one array where children of a node are contiguous and sorted by name, so finding a component is
+  binary search and listing a directory costs the number of its children. Directory without its own entry
+  (like "a/" of "a/b.txt") is implicit node with _entry -1. Names refer to EntryIndex::_names, so the tree is
+  valid while the index is alive. Empty path components (leading, trailing or double '/') are ignored.
+*/
+struct DirectoryTree {
+  struct Node {
+    uint32_t _nameOffset; // offset in EntryIndex::_names
+    uint16_t _nameLength;
+    bool _isDir;
+    int32_t _entry; // index in EntryIndex, -1 for implicit directory.
+    uint32_t _firstChild;
+    uint32_t _childNum;
+  };
+
+  std::vector<Node> _nodes; // _nodes[0] is root.
+
+  void build(const EntryIndex& index) {
+    const std::string& names = index._names;
+    // compare by path component, that is, '/' is lower than any other char, so every subtree is contiguous.
+    auto lessByComponent = [&names, &index](uint32_t a, uint32_t b) {
+      const EntryIndex::Entry& ea = index._entries[a];
+      const EntryIndex::Entry& eb = index._entries[b];
+      size_t len = std::min(ea._fileNameLength, eb._fileNameLength);
+      for(size_t i = 0; i < len; i++) {
+        int ca = names[ea._nameOffset+i] == '/' ? -1 : (uint8_t)names[ea._nameOffset+i];
+        int cb = names[eb._nameOffset+i] == '/' ? -1 : (uint8_t)names[eb._nameOffset+i];
+        if(ca != cb)
+          return ca < cb;
+      }
+      return ea._fileNameLength < eb._fileNameLength;
+    };
+    std::vector<uint32_t> order(index.size());
+    for(size_t i = 0; i < order.size(); i++)
+      order[i] = (uint32_t)i;
+    std::stable_sort(order.begin(), order.end(), lessByComponent);
+
+    // nodes in pre-order with siblings in name order, then renumbered so that siblings are contiguous.
+    std::vector<Node> tmp(1, Node{ 0, 0, true, -1, 0, 0 });
+    std::vector<uint32_t> parents(1, 0);
+    std::vector<uint32_t> path(1, 0); // node of each depth for the previous entry.
+    for(uint32_t idx : order) {
+      const EntryIndex::Entry& ent = index._entries[idx];
+      size_t pos = ent._nameOffset;
+      size_t end = pos+ent._fileNameLength;
+      size_t depth = 0;
+      uint32_t node = 0;
+      while(pos < end) {
+        size_t sep = names.find('/', pos);
+        if(sep == std::string::npos || sep > end)
+          sep = end;
+        if(sep != pos) {
+          depth++;
+          size_t len = sep-pos;
+          if(depth < path.size() && tmp[path[depth]]._nameLength == len && names.compare(tmp[path[depth]]._nameOffset, len, names, pos, len) == 0) {
+            node = path[depth];
+          } else {
+            path.resize(depth);
+            tmp.push_back(Node{ (uint32_t)pos, (uint16_t)len, false, -1, 0, 0 });
+            parents.push_back(node);
+            node = (uint32_t)(tmp.size()-1);
+            path.push_back(node);
+          }
+        }
+        pos = sep+1;
+      }
+      if(node != 0 && tmp[node]._entry == -1)
+        tmp[node]._entry = (int32_t)idx;
+    }
+
+    std::vector<uint32_t> byParent(tmp.size()-1);
+    for(size_t i = 0; i < byParent.size(); i++)
+      byParent[i] = (uint32_t)(i+1);
+    std::stable_sort(byParent.begin(), byParent.end(), [&parents](uint32_t a, uint32_t b) { return parents[a] < parents[b]; });
+    std::vector<uint32_t> newId(tmp.size(), 0);
+    for(size_t i = 0; i < byParent.size(); i++)
+      newId[byParent[i]] = (uint32_t)(i+1);
+
+    _nodes.assign(tmp.size(), Node());
+    for(size_t i = 0; i < tmp.size(); i++)
+      _nodes[newId[i]] = tmp[i];
+    for(size_t i = 0; i < byParent.size(); i++) {
+      Node& parent = _nodes[newId[parents[byParent[i]]]];
+      if(parent._childNum++ == 0)
+        parent._firstChild = (uint32_t)(i+1);
+    }
+    for(Node& n : _nodes)
+      n._isDir = n._childNum != 0 || n._entry == -1 || index.isDir((size_t)n._entry);
+  }
+
+  // return node of child with the name, -1 if not found.
+  int findChild(const EntryIndex& index, uint32_t node, const char* name, size_t len) const {
+    const Node& parent = _nodes[node];
+    uint32_t lo = parent._firstChild;
+    uint32_t hi = parent._firstChild+parent._childNum;
+    while(lo < hi) {
+      uint32_t mid = lo+(hi-lo)/2;
+      int c = index._names.compare(_nodes[mid]._nameOffset, _nodes[mid]._nameLength, name, len);
+      if(c == 0)
+        return (int)mid;
+      if(c < 0)
+        lo = mid+1;
+      else
+        hi = mid;
+    }
+    return -1;
+  }
+
+  // return node of path (like "a/b/" or "a/b.txt", "" is root), -1 if not found.
+  int find(const EntryIndex& index, const char* path, size_t len) const {
+    uint32_t node = 0;
+    size_t pos = 0;
+    while(pos < len) {
+      const char* sep = (const char*)memchr(path+pos, '/', len-pos);
+      size_t end = sep == nullptr ? len : (size_t)(sep-path);
+      if(end != pos) {
+        int child = findChild(index, node, path+pos, end-pos);
+        if(child == -1)
+          return -1;
+        node = (uint32_t)child;
+      }
+      pos = end+1;
+    }
+    return (int)node;
+  }
+
+  /*
+    Call callback(node, path) for each node matching pattern, compared component by component.
+    In a component, '*' matches any characters and '?' matches one character. path of directory ends with '/'.
+  */
+  void glob(const EntryIndex& index, const std::string& pattern, const std::function<void(uint32_t node, const std::string& path)>& callback) const {
+    std::vector<std::string> components;
+    size_t pos = 0;
+    while(pos <= pattern.size()) {
+      size_t sep = pattern.find('/', pos);
+      if(sep == std::string::npos)
+        sep = pattern.size();
+      if(sep != pos)
+        components.push_back(pattern.substr(pos, sep-pos));
+      pos = sep+1;
+    }
+    if(components.empty())
+      return;
+    std::string path;
+    globFrom(index, 0, components, 0, path, callback);
+  }
+
+  static bool MatchComponent(const char* pat, size_t patLen, const char* name, size_t nameLen) {
+    size_t p = 0, n = 0;
+    size_t starPat = std::string::npos, starName = 0;
+    while(n < nameLen) {
+      if(p < patLen && (pat[p] == '?' || pat[p] == name[n])) {
+        p++;
+        n++;
+      } else if(p < patLen && pat[p] == '*') {
+        starPat = p++;
+        starName = n;
+      } else if(starPat != std::string::npos) {
+        p = starPat+1;
+        n = ++starName;
+      } else {
+        return false;
+      }
+    }
+    while(p < patLen && pat[p] == '*')
+      p++;
+    return p == patLen;
+  }
+
+private:
+  void globFrom(const EntryIndex& index, uint32_t node, const std::vector<std::string>& components, size_t depth,
+    std::string& path, const std::function<void(uint32_t node, const std::string& path)>& callback) const {
+    const std::string& comp = components[depth];
+    bool last = depth+1 == components.size();
+    auto visit = [&](uint32_t child) {
+      const Node& n = _nodes[child];
+      if(!last && !n._isDir)
+        return;
+      size_t len = path.size();
+      path.append(index._names, n._nameOffset, n._nameLength);
+      if(n._isDir)
+        path.push_back('/');
+      if(last)
+        callback(child, path);
+      else
+        globFrom(index, child, components, depth+1, path, callback);
+      path.resize(len);
+    };
+
+    if(comp.find_first_of("*?") == std::string::npos) {
+      int child = findChild(index, node, comp.data(), comp.size());
+      if(child != -1)
+        visit((uint32_t)child);
+      return;
+    }
+    const Node& parent = _nodes[node];
+    for(uint32_t child = parent._firstChild; child < parent._firstChild+parent._childNum; child++) {
+      const Node& n = _nodes[child];
+      if(MatchComponent(comp.data(), comp.size(), index._names.data()+n._nameOffset, n._nameLength))
+        visit(child);
+    }
+  }
+};
+
+/*
+  Serialized EntryIndex with the key of the archive, to reopen archive without parsing central directory.
+  Key is archive size, caller supplied stamp (like mtime) and raw bytes of End of Central Directory Record.
+  All values are little endian.
+*/
+struct IndexCache {
+  static const char* Magic() { return "CUZI"; }
+  enum { VERSION = 2, EOCDR_SIZE = 22, HEADER_SIZE = 78 };
 
-      size_t readSize = _file.readAt( origin, buf.data(), bufSize );
-      if (readSize <= EOCDR_SIZE)
-        throw UnZipError("Can't read enough size for End of Central Directory Record. Too small file or read error.");
+  static std::vector<uint8_t> Serialize(File& file, uint64_t stamp, const EOCDRecord& eocd, const EntryIndex& index) {
+    std::vector<uint8_t> buf(Magic(), Magic()+4);
+    Write4Byte(buf, VERSION);
+    Write8Byte(buf, file._size);
+    Write8Byte(buf, stamp);
+    Write8Byte(buf, eocd._eocdOffset);
+    size_t pos = buf.size();
+    buf.resize(pos+EOCDR_SIZE);
+    file.readSpecificSize((size_t)eocd._eocdOffset, &buf[pos], EOCDR_SIZE, "Fail to read End of Central Directory Record.");
+    Write8Byte(buf, eocd._cdEntryNum);
+    Write8Byte(buf, eocd._cdSize);
+    Write8Byte(buf, eocd._cdOffset);
+    index.serialize(buf);
+    return buf;
+  }
 
-      int sigPos = findEndOfCDRInBlock(buf.data(), readSize);
-      if (sigPos == -1)
-        continue;
+  /*
+    Return false if cache is broken or made for other archive. Reads only EOCDR_SIZE bytes from file.
+  */
+  static bool Load(File& file, uint64_t stamp, const uint8_t* data, size_t size, EOCDRecord& eocd, EntryIndex& index) {
+    if(size < HEADER_SIZE || memcmp(data, Magic(), 4) != 0 || Read4Byte(data, 4) != VERSION)
+      return false;
+    if(Read8Byte(data, 8) != file._size || Read8Byte(data, 16) != stamp)
+      return false;
 
-      uint8_t* eocdrBuf = buf.data()+sigPos;
+    uint64_t eocdOffset = Read8Byte(data, 24);
+    if(eocdOffset > file._size || file._size - eocdOffset < EOCDR_SIZE)
+      return false;
+    uint8_t eocdBytes[EOCDR_SIZE];
+    if(file.readAt((size_t)eocdOffset, eocdBytes, EOCDR_SIZE) != EOCDR_SIZE || memcmp(eocdBytes, data+32, EOCDR_SIZE) != 0)
+      return false;
 
-      return EOCDRecord( Read2Byte(eocdrBuf, 10), Read4Byte(eocdrBuf, 12), Read4Byte(eocdrBuf, 16) );      
-    }
-    throw UnZipError("Can't find End of Central Directory Record. Corrupted zip file.");
+    EOCDRecord rec(Read8Byte(data, 54), Read8Byte(data, 62), Read8Byte(data, 70));
+    rec._eocdOffset = eocdOffset;
+    if(!index.deserialize(data+HEADER_SIZE, size-HEADER_SIZE))
+      return false;
+    eocd = rec;
+    return true;
   }
-  
 };
 
-
 } ///<impl
 
 //
 // facade
 //
 
-struct FileEntry {
-  File& _file;
+template<class FileT>
+struct BasicFileEntry {
+  typedef impl::BasicCDRContentReader<FileT> ContentReader;
+
+  FileT& _file;
   impl::CDRecord _entry;
+  ReadOptions _options;
+  // file offset of content if known, 0 means it is read from local file header.
+  // Resolved offset is kept after first read, so later reads do not read local file header again.
+  size_t _dataOffset;
+
+  // entry is moved in, pass std::move or temporary to avoid copy.
+  BasicFileEntry(FileT& file, impl::CDRecord entry, const ReadOptions& options = ReadOptions(), size_t dataOffset = 0) : _file(file), _entry(std::move(entry)), _options(options), _dataOffset(dataOffset) {}
+  BasicFileEntry(const BasicFileEntry&) = default;
+  BasicFileEntry(BasicFileEntry&&) = default;
+  BasicFileEntry& operator=(const BasicFileEntry& src) { _entry = src._entry; _options = src._options; _dataOffset = src._dataOffset; return *this; }
+  BasicFileEntry& operator=(BasicFileEntry&& src) { _entry = std::move(src._entry); _options = src._options; _dataOffset = src._dataOffset; return *this; }
 
-  FileEntry(File& file, impl::CDRecord entry) : _file(file), _entry(entry) {}
-  FileEntry& operator=(const FileEntry& src) { _entry = src._entry; return *this; }
+  void setVerifyCrc(bool verify) { _options._verifyCrc = verify; }
+  void setSpeculativeRead(bool speculative) { _options._speculativeRead = speculative; }
+  void setPipelinedRead(bool pipelined) { _options._pipelinedRead = pipelined; }
 
   bool isDir() const { return _entry.isDir(); }
   const std::string& fileName() const { return _entry._fileName; }
   size_t contentSize() const { return _entry._uncompressedSize; }
 
+  /*
+    Return pointer to content without copy if the entry is stored (no compression) and File supports viewAt.
+    Content size is contentSize(). Otherwise return nullptr, use readContent instead.
+    Also nullptr if compressed and uncompressed sizes of stored entry differ (broken central directory).
+  */
+  const uint8_t* contentView() {
+    if(_entry._compressionMethod != 0 || isDir() || _entry._compressedSize != _entry._uncompressedSize)
+      return nullptr;
+    ContentReader ereader(_file, _entry, _options, _dataOffset);
+    const uint8_t* view = ereader.viewRawContent();
+    keepDataOffset(ereader);
+    return view;
+  }
+
   std::vector<uint8_t> readContent() {
-    impl::CDRContentReader ereader(_file, _entry);
-    return ereader.readContent();
+    ContentReader ereader(_file, _entry, _options, _dataOffset);
+    std::vector<uint8_t> content = ereader.readContent();
+    keepDataOffset(ereader);
+    return content;
+  }
+
+  /*
+    Read content to caller supplied buffer which must be at least contentSize() bytes. Return content size.
+    Temporary buffer for compressed data is allocated by scratch (or std::vector if not specified).
+  */
+  size_t readContentInto(uint8_t* dst, size_t dstSize) {
+    ContentReader ereader(_file, _entry, _options, _dataOffset);
+    size_t len = ereader.readContentInto(dst, dstSize, nullptr);
+    keepDataOffset(ereader);
+    return len;
+  }
+
+  size_t readContentInto(uint8_t* dst, size_t dstSize, ScratchAllocator& scratch) {
+    ContentReader ereader(_file, _entry, _options, _dataOffset);
+    size_t len = ereader.readContentInto(dst, dstSize, &scratch);
+    keepDataOffset(ereader);
+    return len;
+  }
+
+  /*
+    Build seek points every span bytes of content for readRange. Index can be serialized and reused.
+  */
+  impl::SeekIndex buildSeekIndex(size_t span = 1024*1024) {
+    ContentReader ereader(_file, _entry, _options, _dataOffset);
+    impl::SeekIndex index = ereader.buildSeekIndex(span);
+    keepDataOffset(ereader);
+    return index;
+  }
+
+  /*
+    Read at most len bytes of content from offset. Inflation starts from the nearest seek point of index before offset.
+    Without index, inflation starts from the content start.
+  */
+  std::vector<uint8_t> readRange(size_t offset, size_t len) {
+    return readRange(offset, len, nullptr);
+  }
+
+  std::vector<uint8_t> readRange(size_t offset, size_t len, const impl::SeekIndex& index) {
+    return readRange(offset, len, &index);
+  }
+
+  /*
+    Read whole content by threadNum threads (0 means hardware concurrency), each inflating span between seek points of index.
+    Index is built by buildSeekIndex (or deserialized), with smaller span for more parallelism.
+  */
+  std::vector<uint8_t> readContentParallel(const impl::SeekIndex& index, size_t threadNum = 0) {
+    // reader checks sizes, so construct it before allocation.
+    ContentReader ereader(_file, _entry, _options, _dataOffset);
+    std::vector<uint8_t> content(contentSize());
+    ereader.readContentParallel(content.data(), content.size(), index, threadNum);
+    keepDataOffset(ereader);
+    return content;
+  }
+
+  size_t readContentParallelInto(uint8_t* dst, size_t dstSize, const impl::SeekIndex& index, size_t threadNum = 0) {
+    ContentReader ereader(_file, _entry, _options, _dataOffset);
+    size_t len = ereader.readContentParallel(dst, dstSize, index, threadNum);
+    keepDataOffset(ereader);
+    return len;
+  }
+
+  /*
+    Use this instead of readContent for large entry.
+    Returned stream read content chunk by chunk and does not hold whole content in memory.
+  */
+  impl::CDRContentStream openStream() {
+    ContentReader ereader(_file, _entry, _options, _dataOffset);
+    impl::CDRContentStream stream = ereader.openStream();
+    keepDataOffset(ereader);
+    return stream;
+  }
+
+private:
+  void keepDataOffset(const ContentReader& ereader) {
+    if(ereader._offset != 0)
+      _dataOffset = ereader._offset;
+  }
+
+  std::vector<uint8_t> readRange(size_t offset, size_t len, const impl::SeekIndex* index) {
+    if(offset >= contentSize())
+      return std::vector<uint8_t>();
+    ContentReader ereader(_file, _entry, _options, _dataOffset);
+    std::vector<uint8_t> buf(std::min(len, contentSize()-offset));
+    buf.resize(ereader.readRange(offset, buf.data(), buf.size(), index));
+    keepDataOffset(ereader);
+    return buf;
   }
 };
 
-struct file_entry_iterator {
-  File& _file;
+typedef BasicFileEntry<File> FileEntry;
+
+template<class FileT>
+struct basic_file_entry_iterator {
+  typedef BasicFileEntry<FileT> FileEntry;
+
+  FileT& _file;
   size_t _curOffset;
   size_t _endOffset;
+  ReadOptions _options;
 
   bool _setupDone = false;
   size_t _nextOffset = 0;
   FileEntry _curEntry;
   
-  file_entry_iterator(File& file, size_t curOffset, size_t endOffset) : _file(file), _curOffset(curOffset), _endOffset(endOffset), _curEntry(_file, impl::CDRecord()) {}
+  basic_file_entry_iterator(FileT& file, size_t curOffset, size_t endOffset, const ReadOptions& options = ReadOptions()) : _file(file), _curOffset(curOffset), _endOffset(endOffset), _options(options), _curEntry(_file, impl::CDRecord(), options) {}
 
+  // read record into _curEntry, reusing its buffers.
   void ensureInit() {
     if(_setupDone)
       return;
     _setupDone = true;
-    impl::CDReader reader(_file, _curOffset, _endOffset);
-    _curEntry = FileEntry(_file, reader.readOne());
+    impl::BasicCDReader<FileT> reader(_file, _curOffset, _endOffset);
+    reader.readOne(_curEntry._entry);
+    _curEntry._options = _options;
+    _curEntry._dataOffset = 0;
     _nextOffset = reader._curOffset;
   }
 
@@ -422,46 +3513,885 @@ struct file_entry_iterator {
     return _curEntry;
   }
 
-  file_entry_iterator& operator++() {
+  basic_file_entry_iterator& operator++() {
     ensureInit();
     _curOffset = _nextOffset;
     _setupDone = false;
     return *this;
   }
 
-  bool operator ==(const file_entry_iterator& other) const { return _curOffset == other._curOffset; }
-  bool operator !=(const file_entry_iterator& other) const { return _curOffset != other._curOffset; }
+  bool operator ==(const basic_file_entry_iterator& other) const { return _curOffset == other._curOffset; }
+  bool operator !=(const basic_file_entry_iterator& other) const { return _curOffset != other._curOffset; }
 };
 
-struct FileEntryLister {
-  File& _file;
+typedef basic_file_entry_iterator<File> file_entry_iterator;
+
+template<class FileT>
+struct BasicFileEntryLister {
+  FileT& _file;
   size_t _cdStartOffset;
   size_t _cdEndOffset;
+  ReadOptions _options;
 
-  FileEntryLister(File& file, const impl::EOCDRecord& eocdr) : _file(file), _cdStartOffset(eocdr._cdOffset), _cdEndOffset(eocdr._cdOffset+eocdr._cdSize) {}
+  BasicFileEntryLister(FileT& file, const impl::EOCDRecord& eocdr, const ReadOptions& options = ReadOptions()) : _file(file), _cdStartOffset(eocdr._cdOffset), _cdEndOffset(eocdr._cdOffset+eocdr._cdSize), _options(options) {}
 
-  file_entry_iterator begin() const { return file_entry_iterator(_file, _cdStartOffset, _cdEndOffset); }
-  file_entry_iterator end() const { return file_entry_iterator(_file, _cdEndOffset, _cdEndOffset); }
+  basic_file_entry_iterator<FileT> begin() const { return basic_file_entry_iterator<FileT>(_file, _cdStartOffset, _cdEndOffset, _options); }
+  basic_file_entry_iterator<FileT> end() const { return basic_file_entry_iterator<FileT>(_file, _cdEndOffset, _cdEndOffset, _options); }
 };
 
-struct UnZipper {
-  File& _file;
+typedef BasicFileEntryLister<File> FileEntryLister;
+
+/*
+  Entry of UnZipper::listDirectory and UnZipper::glob.
+*/
+struct DirectoryEntry {
+  std::string _path; // full path, directory ends with '/'.
+  bool _isDir;
+  int _index; // index in UnZipper::index(), -1 for directory which has no entry in archive (implicit directory).
+
+  // last component of path, without '/'.
+  std::string name() const {
+    size_t end = _isDir ? _path.size()-1 : _path.size();
+    size_t begin = _path.rfind('/', end == 0 ? 0 : end-1);
+    begin = (begin == std::string::npos || begin >= end) ? 0 : begin+1;
+    return _path.substr(begin, end-begin);
+  }
+};
+
+/*
+  FileT is File or its subclass through which all reads of central directory and content are done.
+  UnZipper (FileT = File) works with any backend by virtual dispatch. With concrete backend which has non-virtual
+  readAt and viewAt (like MappedFile), BasicUnZipper<MappedFile> calls them directly, so that they are inlined
+  into parse and read loops.
+
+  MappedFile file("test.zip");
+  BasicUnZipper<MappedFile> unzipper(file);
+*/
+template<class FileT>
+struct BasicUnZipper {
+  typedef BasicFileEntry<FileT> FileEntry;
+
+  FileT& _file;
   impl::EOCDRecord _eocdRecord;
+  impl::EntryIndex _index;
+  bool _indexBuilt = false;
+  bool _indexFromCache = false;
+  ReadOptions _options;
+  ContentCache* _contentCache = nullptr;
+  impl::DirectoryTree _tree;
+  bool _treeBuilt = false;
+
+  BasicUnZipper(FileT& file) : _file(file), _eocdRecord( ReadEOCDRecord(file) ) {}
+
+  /*
+    Reopen archive with cache made by saveIndexCache. stamp must be the same value given to saveIndexCache
+    (like mtime of archive), and archive size and End of Central Directory Record are checked too.
+    If cache does not match, fall back to normal open.
+  */
+  BasicUnZipper(FileT& file, const uint8_t* cache, size_t cacheSize, uint64_t stamp) : _file(file), _eocdRecord(0, 0, 0) {
+    if(impl::IndexCache::Load(file, stamp, cache, cacheSize, _eocdRecord, _index)) {
+      _indexBuilt = true;
+      _indexFromCache = true;
+      return;
+    }
+    _index = impl::EntryIndex();
+    _eocdRecord = ReadEOCDRecord(file);
+  }
 
-  UnZipper(File& file) : _file(file), _eocdRecord( ReadEOCDRecord(file) ) {}
+  /*
+    Serialize index with data offset of all entries for later reopen. Caller saves it anywhere (like sidecar file).
+    This reads local file header of each entry once to resolve data offset.
+  */
+  std::vector<uint8_t> saveIndexCache(uint64_t stamp) {
+    resolveDataOffsets();
+    return impl::IndexCache::Serialize(_file, stamp, _eocdRecord, _index);
+  }
+
+  // true if opened from valid cache.
+  bool isIndexFromCache() const { return _indexFromCache; }
+
+  /*
+    Read local file header of all entries once and keep data offset in index,
+    so that FileEntry from entryAt and findEntry read content without reading local file header.
+  */
+  void resolveDataOffsets() {
+    index();
+    _index.resolveDataOffsets(_file);
+  }
 
   size_t fileEntryNum() const { return (size_t)_eocdRecord._cdEntryNum; }
 
-  FileEntryLister listFiles() { return FileEntryLister(_file, _eocdRecord); }
+  /*
+    If true, FileEntry returned after this call verify CRC-32 of content while reading it,
+    and throw UnZipError on mismatch. Default is false.
+  */
+  void setVerifyCrc(bool verify) { _options._verifyCrc = verify; }
+
+  /*
+    If true, FileEntry returned after this call read local file header and content by one read. See ReadOptions.
+  */
+  void setSpeculativeRead(bool speculative) { _options._speculativeRead = speculative; }
+
+  /*
+    If true, FileEntry returned after this call read compressed data by a reader thread ahead of inflation. See ReadOptions.
+  */
+  void setPipelinedRead(bool pipelined) { _options._pipelinedRead = pipelined; }
+
+  BasicFileEntryLister<FileT> listFiles() { return BasicFileEntryLister<FileT>(_file, _eocdRecord, _options); }
+
+  /*
+    Cache content read by readSharedContent in cache (nullptr to stop). Cache must outlive this UnZipper,
+    and can be shared by UnZipper of other archives.
+  */
+  void setContentCache(ContentCache* cache) { _contentCache = cache; }
+
+  /*
+    Parse whole central directory once and build index for lookup by name.
+    indexOf, entryAt and findEntry build index automatically if not yet built.
+  */
+  void buildIndex() {
+    impl::StatsTimer timer;
+    _index.build(_file, _eocdRecord);
+    _indexBuilt = true;
+    CPPUNZIP_STATS(_file, onCentralDirectoryParse(_index.size(), timer.elapsed()));
+  }
+
+  /*
+    Report reads and inflation of this archive to observer (nullptr to stop). Observer is set to File, so it is shared
+    with other UnZipper of the same File. No effect unless CPPUNZIP_ENABLE_STATS is defined.
+  */
+  void setStatsObserver(StatsObserver* observer) {
+#ifdef CPPUNZIP_ENABLE_STATS
+    _file._observer = observer;
+#else
+    (void)observer;
+#endif
+  }
+
+  const impl::EntryIndex& index() {
+    if(!_indexBuilt)
+      buildIndex();
+    return _index;
+  }
+
+  // return -1 if not found.
+  int indexOf(const std::string& name) { return index().indexOf(name.data(), name.size()); }
+
+  FileEntry entryAt(size_t idx) {
+    if(idx >= index().size())
+      throw UnZipError("Entry index out of range.");
+    return FileEntry(_file, _index.toRecord(idx), _options, (size_t)_index._entries[idx]._dataOffset);
+  }
+
+  /*
+    Read whole central directory by one read and iterate CDRecordView.
+  */
+  impl::BasicBulkCDReader<FileT> readCentralDirectory() { return impl::BasicBulkCDReader<FileT>(_file, _eocdRecord); }
+
+  // build on first call (and index if not yet).
+  const impl::DirectoryTree& directoryTree() {
+    if(!_treeBuilt) {
+      _tree.build(index());
+      _treeBuilt = true;
+    }
+    return _tree;
+  }
+
+  /*
+    List children of directory dir (like "a/b/", "" for root) in name order, including implicit directories.
+    Cost is proportional to depth and the number of children. Throw UnZipError if dir is not a directory.
+  */
+  std::vector<DirectoryEntry> listDirectory(const std::string& dir) {
+    const impl::DirectoryTree& tree = directoryTree();
+    int node = tree.find(_index, dir.data(), dir.size());
+    if(node == -1 || !tree._nodes[node]._isDir)
+      throw UnZipError("Directory not found: " + dir);
+
+    // dir without empty components, ends with '/' unless root.
+    std::string base;
+    for(size_t pos = 0; pos < dir.size();) {
+      size_t sep = std::min(dir.find('/', pos), dir.size());
+      if(sep != pos) {
+        base.append(dir, pos, sep-pos);
+        base.push_back('/');
+      }
+      pos = sep+1;
+    }
+    const impl::DirectoryTree::Node& parent = tree._nodes[node];
+    std::vector<DirectoryEntry> result;
+    result.reserve(parent._childNum);
+    for(uint32_t child = parent._firstChild; child < parent._firstChild+parent._childNum; child++) {
+      const impl::DirectoryTree::Node& n = tree._nodes[child];
+      DirectoryEntry ent;
+      ent._path = base;
+      ent._path.append(_index._names, n._nameOffset, n._nameLength);
+      if(n._isDir)
+        ent._path.push_back('/');
+      ent._isDir = n._isDir;
+      ent._index = n._entry;
+      result.push_back(std::move(ent));
+    }
+    return result;
+  }
+
+  /*
+    Return entries matching pattern like "assets/textures/t_??.png" in name order by component.
+    '*' and '?' match within one path component, and components without them are found by binary search.
+  */
+  std::vector<DirectoryEntry> glob(const std::string& pattern) {
+    const impl::DirectoryTree& tree = directoryTree();
+    std::vector<DirectoryEntry> result;
+    tree.glob(_index, pattern, [&](uint32_t node, const std::string& path) {
+      DirectoryEntry ent;
+      ent._path = path;
+      ent._isDir = tree._nodes[node]._isDir;
+      ent._index = tree._nodes[node]._entry;
+      result.push_back(std::move(ent));
+    });
+    return result;
+  }
+
+  /*
+    Read central directory by pages of blockSize bytes on demand.
+  */
+  impl::BasicPagedCDReader<FileT> readCentralDirectoryPaged(size_t blockSize = 256*1024) { return impl::BasicPagedCDReader<FileT>(_file, _eocdRecord, blockSize); }
+
+  /*
+    Call callback with entries whose name starts with prefix (all entries if empty) in central directory order,
+    until callback returns false. Return the number of callback calls.
+    If index is not built, central directory is read by pages of blockSize bytes only as far as needed,
+    and FileEntry is made only for matching entries. If index is built, it is scanned without read.
+  */
+  size_t forEachEntry(const std::string& prefix, std::function<bool(FileEntry& entry)> callback, size_t blockSize = 256*1024) {
+    size_t matched = 0;
+    if(_indexBuilt) {
+      for(size_t i = 0; i < _index.size(); i++) {
+        const impl::EntryIndex::Entry& ent = _index._entries[i];
+        if(ent._fileNameLength < prefix.size() || _index._names.compare(ent._nameOffset, prefix.size(), prefix) != 0)
+          continue;
+        matched++;
+        FileEntry entry = entryAt(i);
+        if(!callback(entry))
+          break;
+      }
+      return matched;
+    }
+
+    impl::BasicPagedCDReader<FileT> reader(_file, _eocdRecord, blockSize);
+    while(!reader.isEnd()) {
+      impl::CDRecordView rec = reader.readOne();
+      if(rec._fileNameLength < prefix.size() || memcmp(rec._fileName, prefix.data(), prefix.size()) != 0)
+        continue;
+      matched++;
+      FileEntry entry(_file, rec.toRecord(), _options);
+      if(!callback(entry))
+        break;
+    }
+    return matched;
+  }
+
+  FileEntry findEntry(const std::string& name) {
+    int idx = indexOf(name);
+    if(idx == -1)
+      throw UnZipError("Entry not found: " + name);
+    return entryAt((size_t)idx);
+  }
+
+  /*
+    Read content of entry at idx as shared immutable buffer. With cache set by setContentCache, repeated reads of
+    the same entry return cached content without reading and inflating it again.
+    Can be called from multiple threads after buildIndex if File supportsConcurrentRead.
+  */
+  SharedContent readSharedContent(size_t idx) {
+    if(_contentCache != nullptr) {
+      SharedContent content = _contentCache->find(&_file, idx);
+      if(content)
+        return content;
+    }
+    std::vector<uint8_t> content = entryAt(idx).readContent();
+    if(_contentCache == nullptr)
+      return std::make_shared<const std::vector<uint8_t>>(std::move(content));
+    return _contentCache->insert(&_file, idx, std::move(content));
+  }
+
+  SharedContent readSharedContent(const std::string& name) {
+    int idx = indexOf(name);
+    if(idx == -1)
+      throw UnZipError("Entry not found: " + name);
+    return readSharedContent((size_t)idx);
+  }
+
+  typedef std::function<void(FileEntry& entry, std::vector<uint8_t>& content)> ExtractCallback;
+
+  /*
+    Read content of all non-directory entries with threadNum worker threads (0 means hardware concurrency).
+    callback is called from worker threads concurrently, so it must be thread safe.
+    Entries are handed out in descending order of compressed size so that workers finish at nearly the same time.
+    If File does not supportsConcurrentRead, reading raw content is serialized by mutex and only inflation runs in parallel.
+    If File supportsAsyncRead, each worker keeps compressed data of next prefetchNum entries in flight while inflating current one.
+    The first exception thrown in workers is rethrown after all workers stop.
+  */
+  void extractAll(ExtractCallback callback, size_t threadNum = 0, size_t prefetchNum = 4) {
+    const impl::EntryIndex& idx = index();
+
+    std::vector<size_t> order;
+    order.reserve(idx.size());
+    for(size_t i = 0; i < idx.size(); i++) {
+      if(!idx.isDir(i))
+        order.push_back(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&idx](size_t a, size_t b) {
+      return idx._entries[a]._compressedSize > idx._entries[b]._compressedSize;
+    });
+
+    if(threadNum == 0)
+      threadNum = std::max(std::thread::hardware_concurrency(), 1u);
+    threadNum = std::min(threadNum, std::max(order.size(), (size_t)1));
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> failed(false);
+    std::mutex readMutex;
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    bool concurrentRead = _file.supportsConcurrentRead();
+
+    auto onError = [&]() {
+      std::lock_guard<std::mutex> lock(errorMutex);
+      if(!error)
+        error = std::current_exception();
+      failed = true;
+    };
+
+    // local header is read with raw content by one request if data offset is not resolved yet.
+    ReadOptions headerOptions = _options;
+    headerOptions._speculativeRead = true;
+
+    auto prefetchWorker = [&]() {
+      std::deque<Prefetch> pending;
+      try {
+        while(true) {
+          std::vector<ReadRequest*> reqs;
+          while(pending.size() < std::max(prefetchNum, (size_t)1) && !failed) {
+            size_t i = next++;
+            if(i >= order.size())
+              break;
+            const impl::EntryIndex::Entry& e = idx._entries[order[i]];
+            pending.emplace_back();
+            Prefetch& p = pending.back();
+            idx.toRecord(order[i], p._record);
+            p._reader.reset(new impl::BasicCDRContentReader<FileT>(_file, p._record, headerOptions, (size_t)e._dataOffset));
+            p._withHeader = p._reader->useSpeculativeRead();
+            p._buf.resize(p._withHeader ? p._reader->speculativeSize() : p._reader->compressedSize());
+            p._req = ReadRequest(p._withHeader ? (size_t)e._localHeaderOffset : p._reader->dataOffset(), p._buf.data(), p._buf.size());
+            reqs.push_back(&p._req);
+          }
+          if(!reqs.empty()) {
+            std::unique_lock<std::mutex> lock(readMutex, std::defer_lock);
+            if(!concurrentRead)
+              lock.lock();
+            _file.submitRead(reqs.data(), reqs.size());
+            for(auto& p : pending)
+              p._submitted = true;
+          }
+          if(pending.empty())
+            return;
+
+          Prefetch& p = pending.front();
+          size_t len;
+          {
+            std::unique_lock<std::mutex> lock(readMutex, std::defer_lock);
+            if(!concurrentRead)
+              lock.lock();
+            len = _file.waitRead(p._req);
+          }
+          const uint8_t* raw = p._buf.data();
+          if(p._withHeader) {
+            std::unique_lock<std::mutex> lock(readMutex, std::defer_lock);
+            if(!concurrentRead)
+              lock.lock();
+            raw = p._reader->completeSpeculative(p._buf, len);
+          }
+          else if(len != p._buf.size())
+            throw UnZipError("Can't read enough in readRawContent.");
+
+          std::vector<uint8_t> content = p._reader->decompressContent(raw);
+          size_t dataOffset = p._reader->dataOffset();
+          p._reader.reset();
+          FileEntry entry(_file, std::move(p._record), _options, dataOffset);
+          pending.pop_front();
+          callback(entry, content);
+        }
+      } catch(...) {
+        onError();
+        // buffers must outlive in flight reads. Entries failed before submitRead have nothing to wait.
+        for(auto& p : pending) {
+          if(!p._submitted)
+            continue;
+          try {
+            std::unique_lock<std::mutex> lock(readMutex, std::defer_lock);
+            if(!concurrentRead)
+              lock.lock();
+            _file.waitRead(p._req);
+          } catch(...) {}
+        }
+      }
+    };
+
+    auto worker = [&]() {
+      if(_file.supportsAsyncRead()) {
+        prefetchWorker();
+        return;
+      }
+      try {
+        while(!failed) {
+          size_t i = next++;
+          if(i >= order.size())
+            return;
+
+          FileEntry entry(_file, idx.toRecord(order[i]), _options, (size_t)idx._entries[order[i]]._dataOffset);
+          std::vector<uint8_t> content;
+          if(concurrentRead) {
+            content = entry.readContent();
+          } else {
+            std::unique_lock<std::mutex> lock(readMutex);
+            impl::BasicCDRContentReader<FileT> reader(_file, entry._entry, _options, entry._dataOffset);
+            std::vector<uint8_t> raw = reader.readRawContent();
+            lock.unlock();
+            content = reader.decompressContent(std::move(raw));
+          }
+          callback(entry, content);
+        }
+      } catch(...) {
+        onError();
+      }
+    };
+
+    if(threadNum <= 1) {
+      worker();
+    } else {
+      std::vector<std::thread> threads;
+      for(size_t i = 0; i < threadNum; i++)
+        threads.push_back(std::thread(worker));
+      for(auto& t : threads)
+        t.join();
+    }
+    if(error)
+      std::rethrow_exception(error);
+  }
+
+  /*
+    Read content of selected entries (index in index(), as returned by indexOf) with reads sorted by local header offset.
+    Entries whose gap is at most maxGap are read by one sequential read of at most maxReadSize bytes,
+    so that random reads become a few sequential sweeps. callback is called from the calling thread
+    in ascending order of local header offset. Directory entries are skipped like extractAll.
+  */
+  void readEntries(const std::vector<size_t>& indices, ExtractCallback callback, size_t maxGap = 64*1024, size_t maxReadSize = 16*1024*1024) {
+    std::vector<FileEntry> entries;
+    entries.reserve(indices.size());
+    for(size_t i : indices)
+      entries.push_back(entryAt(i));
+    readEntries(std::move(entries), callback, maxGap, maxReadSize);
+  }
+
+  // Same as above for entries from listFiles, entryAt or findEntry of this UnZipper.
+  void readEntries(std::vector<FileEntry> entries, ExtractCallback callback, size_t maxGap = 64*1024, size_t maxReadSize = 16*1024*1024) {
+    for(const FileEntry& e : entries) {
+      if(&e._file != &_file)
+        throw UnZipError("Entry of other archive is given to readEntries.");
+    }
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [](const FileEntry& e) { return e.isDir(); }), entries.end());
+    std::stable_sort(entries.begin(), entries.end(), [](const FileEntry& a, const FileEntry& b) {
+      return a._entry._localHeaderOffset < b._entry._localHeaderOffset;
+    });
+
+    // local header is read with raw content if data offset is not resolved yet.
+    ReadOptions headerOptions = _options;
+    headerOptions._speculativeRead = true;
+
+    std::vector<uint8_t> buf;
+    size_t i = 0;
+    while(i < entries.size()) {
+      size_t start = (size_t)entries[i]._entry._localHeaderOffset;
+      size_t end = start+rawExtent(entries[i], headerOptions);
+      size_t last = i+1;
+      for(; last < entries.size(); last++) {
+        size_t nextStart = (size_t)entries[last]._entry._localHeaderOffset;
+        size_t nextEnd = std::max(end, nextStart+rawExtent(entries[last], headerOptions));
+        if(nextStart > end && nextStart-end > maxGap)
+          break;
+        if(nextEnd-start > maxReadSize)
+          break;
+        end = nextEnd;
+      }
+
+      const uint8_t* data = _file.viewAt(start, end-start);
+      if(data == nullptr) {
+        buf.resize(end-start);
+        _file.readSpecificSize(start, buf.data(), buf.size(), "Fail to read expected size in readEntries");
+        data = buf.data();
+      }
+
+      for(; i < last; i++) {
+        FileEntry& entry = entries[i];
+        impl::BasicCDRContentReader<FileT> reader(_file, entry._entry, headerOptions, entry._dataOffset);
+        size_t headerPos = (size_t)entry._entry._localHeaderOffset-start;
+        if(reader._offset == 0) {
+          if(headerPos+reader.LOCAL_FILE_HEADER_SIZE > end-start)
+            throw UnZipError("Fail to read expected size in readEntries");
+          reader._offset = reader.parseLocalFileHeader(data+headerPos);
+        }
+        size_t rawPos = reader._offset-start;
+        std::vector<uint8_t> content;
+        if(rawPos+reader.compressedSize() <= end-start)
+          content = reader.decompressContent(data+rawPos);
+        else // local extra field is larger than estimated.
+          content = reader.decompressContent(reader.readRawContent());
+        entry._dataOffset = reader._offset;
+        callback(entry, content);
+      }
+    }
+  }
 
 private:
-  static impl::EOCDRecord ReadEOCDRecord(File& file) {
-    impl::EOCDRReader reader(
-      file);
+  // entry of which compressed data is in flight in extractAll.
+  struct Prefetch {
+    impl::CDRecord _record;
+    std::unique_ptr<impl::BasicCDRContentReader<FileT>> _reader; // refers _record.
+    std::vector<uint8_t> _buf;
+    ReadRequest _req;
+    bool _withHeader = false;
+    bool _submitted = false;
+  };
+
+  // bytes from local header to the end of raw content, estimated if data offset is not resolved yet.
+  size_t rawExtent(const FileEntry& entry, const ReadOptions& headerOptions) {
+    size_t headerOffset = (size_t)entry._entry._localHeaderOffset;
+    if(entry._dataOffset != 0 && entry._dataOffset > headerOffset)
+      return entry._dataOffset+(size_t)entry._entry._compressedSize-headerOffset;
+    impl::BasicCDRContentReader<FileT> reader(_file, entry._entry, headerOptions);
+    return reader.speculativeSize();
+  }
+
+  static impl::EOCDRecord ReadEOCDRecord(FileT& file) {
+    impl::BasicEOCDRReader<FileT> reader(file);
 
     return reader.readEOCDRecord();
   }
 };
 
+typedef BasicUnZipper<File> UnZipper;
+
+/*
+  Forward-only unzip over non seekable stream (like pipe or socket).
+  Walk local file headers from the beginning without End of Central Directory Record and Central Directory,
+  so entries can be processed while the archive is arriving. Memory usage is constant if content is read by read().
+
+  Entry with data descriptor (flag bit 3) is inflated until the end of deflate stream, then sizes and CRC-32 are taken from the descriptor.
+  Stored entry with data descriptor and unknown size ends at the data descriptor signature with matching sizes.
+
+  StreamUnZipper unzipper(is);
+  while(unzipper.next()) {
+    // unzipper.fileName(), unzipper.read(buf, size) ...
+  }
+*/
+struct StreamUnZipper {
+  std::istream& _istream;
+
+  const size_t BUFFER_SIZE = 64*1024;
+  const size_t LOCAL_FILE_HEADER_SIZE = 30;
+
+  std::vector<uint8_t> _buf;
+  size_t _bufPos = 0;
+  size_t _bufEnd = 0;
+  uint64_t _streamPos = 0; // archive offset of _buf[0].
+
+  impl::CDRecord _entry; // from local file header. Sizes and crc are updated by data descriptor at the end of entry.
+  bool _inEntry = false;
+  bool _entryEnd = false;
+  bool _hasDescriptor = false;
+  bool _zip64 = false;
+  bool _unknownSize = false; // stored entry with data descriptor.
+  uint64_t _compressedLeft = 0; // stored entry only.
+  uint64_t _totalIn = 0;
+  uint64_t _totalOut = 0;
+  uint32_t _crc = 0;
+  bool _verifyCrc = false;
+  bool _finished = false;
+
+  std::unique_ptr<z_stream, impl::CDRContentStream::ZStreamDeleter> _zs;
+
+  StreamUnZipper(std::istream& istream) : _istream(istream), _buf(BUFFER_SIZE) {}
+
+  // If true, CRC-32 of each entry is checked at the end of the entry, and read throws UnZipError on mismatch.
+  void setVerifyCrc(bool verify) { _verifyCrc = verify; }
+
+  /*
+    Move to next entry. Unread content of current entry is skipped.
+    Return false when reaching Central Directory (end of entries).
+  */
+  bool next() {
+    if(_finished)
+      return false;
+    if(_inEntry) {
+      uint8_t skipBuf[4096];
+      while(read(skipBuf, sizeof(skipBuf)) != 0)
+        ;
+    }
+    _inEntry = false;
+
+    if(!ensure(4))
+      throw UnZipError("Unexpected end of stream before Central Directory.");
+    uint32_t sig = impl::Read4Byte(_buf.data(), _bufPos);
+    if(sig == 0x02014b50 || sig == 0x06054b50 || sig == 0x06064b50) {
+      _finished = true;
+      return false;
+    }
+    if(sig != 0x04034b50)
+      throw UnZipError("Local File header signature does not match.");
+
+    if(!ensure(LOCAL_FILE_HEADER_SIZE))
+      throw UnZipError("Unexpected end of stream in local file header.");
+    const uint8_t* h = _buf.data()+_bufPos;
+    _entry._localHeaderOffset = _streamPos+_bufPos;
+    _entry._flags = impl::Read2Byte(h, 6);
+    _entry._compressionMethod = impl::Read2Byte(h, 8);
+    _entry._lastModTime = impl::Read2Byte(h, 10);
+    _entry._lastModDate = impl::Read2Byte(h, 12);
+    _entry._crc = impl::Read4Byte(h, 14);
+    _entry._compressedSize = impl::Read4Byte(h, 18);
+    _entry._uncompressedSize = impl::Read4Byte(h, 22);
+    _entry._fileNameLength = impl::Read2Byte(h, 26);
+    _entry._extraFieldLength = impl::Read2Byte(h, 28);
+    _entry._commentLength = 0;
+
+    size_t varLen = (size_t)_entry._fileNameLength+_entry._extraFieldLength;
+    if(!ensure(LOCAL_FILE_HEADER_SIZE+varLen))
+      throw UnZipError("Unexpected end of stream in local file header.");
+    const uint8_t* var = _buf.data()+_bufPos+LOCAL_FILE_HEADER_SIZE;
+    _entry._fileName.assign((const char*)var, _entry._fileNameLength);
+    _entry._extraField.assign(var+_entry._fileNameLength, var+varLen);
+    _entry._comment.clear();
+    _bufPos += LOCAL_FILE_HEADER_SIZE+varLen;
+
+    if(_entry._flags & 1)
+      throw UnZipError("Encrypted entry is not supported: " + _entry._fileName);
+    if(_entry._compressionMethod != 0 && _entry._compressionMethod != 8)
+      throw UnZipError("Only deflate compression is supported");
+
+    _zip64 = hasZip64Extra();
+    _entry.applyZip64Extra(_entry._extraField.data(), _entry._extraField.size());
+    _hasDescriptor = (_entry._flags & 8) != 0;
+    _unknownSize = _hasDescriptor && _entry._compressionMethod == 0 && _entry._compressedSize == 0;
+
+    _compressedLeft = _entry._compressedSize;
+    _totalIn = 0;
+    _totalOut = 0;
+    _crc = 0;
+    _inEntry = true;
+    _entryEnd = false;
+    if(_entry._compressionMethod == 8)
+      resetInflater();
+    return true;
+  }
+
+  // information of current entry from local file header. With data descriptor, sizes are valid only after whole content is read.
+  const impl::CDRecord& entry() const { return _entry; }
+  const std::string& fileName() const { return _entry._fileName; }
+  bool isDir() const { return _entry.isDir(); }
+
+  /*
+    Read at most size bytes of current entry content. Return 0 at the end of entry.
+  */
+  size_t read(uint8_t* dst, size_t size) {
+    if(!_inEntry || _entryEnd || size == 0)
+      return 0;
+    size_t len;
+    if(_entry._compressionMethod == 8)
+      len = readDeflated(dst, size);
+    else
+      len = _unknownSize ? readStoredUntilDescriptor(dst, size) : readStored(dst, size);
+    if(_verifyCrc)
+      _crc = impl::UpdateCrc(_crc, dst, len);
+    _totalOut += len;
+    if(_entryEnd)
+      finishEntry();
+    return len;
+  }
+
+  // read whole content of current entry.
+  std::vector<uint8_t> readContent() {
+    std::vector<uint8_t> content;
+    if(!_hasDescriptor)
+      content.reserve((size_t)_entry._uncompressedSize);
+    uint8_t chunk[16*1024];
+    size_t len;
+    while((len = read(chunk, sizeof(chunk))) != 0)
+      content.insert(content.end(), chunk, chunk+len);
+    return content;
+  }
+
+private:
+  // make at least n bytes available from _bufPos. Return false if stream ends before.
+  bool ensure(size_t n) {
+    if(_bufEnd-_bufPos >= n)
+      return true;
+    if(_bufPos != 0) {
+      memmove(_buf.data(), _buf.data()+_bufPos, _bufEnd-_bufPos);
+      _streamPos += _bufPos;
+      _bufEnd -= _bufPos;
+      _bufPos = 0;
+    }
+    if(_buf.size() < n)
+      _buf.resize(n);
+    while(_bufEnd < n && fill())
+      ;
+    return _bufEnd >= n;
+  }
+
+  // read more into free space of _buf. Return false at end of stream.
+  bool fill() {
+    if(_bufPos == _bufEnd) {
+      _streamPos += _bufEnd;
+      _bufPos = _bufEnd = 0;
+    }
+    if(_bufEnd == _buf.size())
+      return true;
+    _istream.read((char*)_buf.data()+_bufEnd, _buf.size()-_bufEnd);
+    size_t len = (size_t)_istream.gcount();
+    _bufEnd += len;
+    return len != 0;
+  }
+
+  bool hasZip64Extra() const {
+    const std::vector<uint8_t>& extra = _entry._extraField;
+    for(size_t pos = 0; pos+4 <= extra.size(); pos += 4+impl::Read2Byte(extra.data(), pos+2)) {
+      if(impl::Read2Byte(extra.data(), pos) == 0x0001)
+        return true;
+    }
+    return false;
+  }
+
+  void resetInflater() {
+    if(!_zs) {
+      _zs.reset(new z_stream());
+      memset(_zs.get(), 0, sizeof(z_stream));
+      if(inflateInit2(_zs.get(), -MAX_WBITS) != Z_OK) {
+        delete _zs.release();
+        throw UnZipError("Fail to inflateInit2.");
+      }
+    } else if(inflateReset(_zs.get()) != Z_OK) {
+      throw UnZipError("Fail to inflateReset.");
+    }
+  }
+
+  size_t readStored(uint8_t* dst, size_t size) {
+    size_t total = 0;
+    while(total < size && _compressedLeft != 0) {
+      if(_bufPos == _bufEnd && !fill())
+        throw UnZipError("Unexpected end of stream in entry content: " + _entry._fileName);
+      size_t len = (size_t)std::min((uint64_t)std::min(size-total, _bufEnd-_bufPos), _compressedLeft);
+      memcpy(dst+total, _buf.data()+_bufPos, len);
+      _bufPos += len;
+      _compressedLeft -= len;
+      _totalIn += len;
+      total += len;
+    }
+    if(_compressedLeft == 0)
+      _entryEnd = true;
+    return total;
+  }
+
+  // true if data descriptor with sizes of content so far starts at p.
+  bool isDescriptorAt(size_t p) const {
+    const uint8_t* d = _buf.data()+p;
+    if(impl::Read4Byte(d, 0) != 0x08074b50)
+      return false;
+    uint64_t size = _totalIn + (p-_bufPos);
+    if(_zip64)
+      return impl::Read8Byte(d, 8) == size && impl::Read8Byte(d, 16) == size;
+    return impl::Read4Byte(d, 8) == size && impl::Read4Byte(d, 12) == size;
+  }
+
+  size_t readStoredUntilDescriptor(uint8_t* dst, size_t size) {
+    size_t descLen = _zip64 ? 24 : 16;
+    size_t total = 0;
+    while(total < size) {
+      if(_bufEnd-_bufPos < descLen && !ensure(descLen))
+        throw UnZipError("Unexpected end of stream before data descriptor: " + _entry._fileName);
+      // positions before p are checked with whole descriptor length, so they are content for sure.
+      size_t p = _bufPos;
+      size_t last = _bufEnd-descLen;
+      while(p <= last && p-_bufPos < size-total && !isDescriptorAt(p))
+        p++;
+      size_t len = p-_bufPos;
+      memcpy(dst+total, _buf.data()+_bufPos, len);
+      _bufPos += len;
+      _totalIn += len;
+      total += len;
+      if(p <= last && total < size && isDescriptorAt(p)) {
+        _entryEnd = true;
+        break;
+      }
+    }
+    return total;
+  }
+
+  size_t readDeflated(uint8_t* dst, size_t size) {
+    z_stream& s = *_zs;
+    s.next_out = dst;
+    s.avail_out = (uint32_t)std::min(size, (size_t)1 << 30);
+    size_t requested = s.avail_out;
+
+    while(s.avail_out != 0) {
+      if(_bufPos == _bufEnd && !fill())
+        throw UnZipError("Unexpected end of stream in entry content: " + _entry._fileName);
+      size_t avail = _bufEnd-_bufPos;
+      // without data descriptor compressed size is known, do not pass bytes of next header.
+      if(!_hasDescriptor)
+        avail = (size_t)std::min((uint64_t)avail, _entry._compressedSize-_totalIn);
+      s.next_in = (Bytef*)_buf.data()+_bufPos;
+      s.avail_in = (uint32_t)std::min(avail, (size_t)1 << 30);
+      uint32_t availIn = s.avail_in;
+
+      int status = inflate(&s, Z_NO_FLUSH);
+      size_t consumed = availIn - s.avail_in;
+      _bufPos += consumed;
+      _totalIn += consumed;
+      if(status == Z_STREAM_END) {
+        _entryEnd = true;
+        break;
+      }
+      if(status == Z_BUF_ERROR && !_hasDescriptor && _totalIn == _entry._compressedSize)
+        throw UnZipError("Compressed data ends before deflate stream end.");
+      if(status != Z_OK && status != Z_BUF_ERROR)
+        throw UnZipError("Fail to inflate: " + std::to_string(status));
+    }
+    return requested - s.avail_out;
+  }
+
+  // read data descriptor if exists, then check sizes and crc.
+  void finishEntry() {
+    if(_hasDescriptor) {
+      size_t sizeLen = _zip64 ? 8 : 4;
+      if(!ensure(4))
+        throw UnZipError("Unexpected end of stream in data descriptor.");
+      // signature is optional.
+      if(impl::Read4Byte(_buf.data(), _bufPos) == 0x08074b50)
+        _bufPos += 4;
+      if(!ensure(4+sizeLen*2))
+        throw UnZipError("Unexpected end of stream in data descriptor.");
+      const uint8_t* d = _buf.data()+_bufPos;
+      _entry._crc = impl::Read4Byte(d, 0);
+      _entry._compressedSize = _zip64 ? impl::Read8Byte(d, 4) : impl::Read4Byte(d, 4);
+      _entry._uncompressedSize = _zip64 ? impl::Read8Byte(d, 4+sizeLen) : impl::Read4Byte(d, 4+sizeLen);
+      _bufPos += 4+sizeLen*2;
+    }
+    if(_totalIn != _entry._compressedSize || _totalOut != _entry._uncompressedSize)
+      throw UnZipError("Entry size differs from header: " + _entry._fileName);
+    if(_verifyCrc && _crc != _entry._crc)
+      throw UnZipError("CRC-32 mismatch: " + _entry._fileName);
+  }
+};
+
 } ///<cppunzip
 #endif
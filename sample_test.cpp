@@ -3,6 +3,7 @@
 #include <vector>
 #include <fstream>
 #include <cstdio>
+#include <cstring>
 
 using namespace cppunzip;
 
@@ -11,7 +12,7 @@ void testIStreamFile(File& f) {
 
   cout << f._size << endl;
   vector<uint8_t> buf(50);
-  int res = f.readAt(f._size-50, buf.data(), 50);
+  size_t res = f.readAt(f._size-50, buf.data(), 50);
   cout << res << endl;
   printf("%x, %x, %x, %x\n", buf[42], buf[43], buf[44], buf[45]);
 }
@@ -22,27 +23,40 @@ void testInternalAPI(File& f) {
 
   EOCDRReader unzipper(f);
   EOCDRecord eocdr = unzipper.readEOCDRecord();
-  printf("entryNum=%d, size=%x, offset=%x\n", eocdr._cdEntryNum, eocdr._cdSize, eocdr._cdOffset);
+  printf("entryNum=%llu, size=%llx, offset=%llx\n", (unsigned long long)eocdr._cdEntryNum, (unsigned long long)eocdr._cdSize, (unsigned long long)eocdr._cdOffset);
 
   CDReader reader(f, eocdr);
   while(!reader.isEnd()) {
     CDRecord cdr = reader.readOne();
     printf("name=%s\n", cdr._fileName.c_str() );
-    printf("   comp=%d, csize=%d, usize=%d\n", cdr._compressionMethod, cdr._compressedSize, cdr._uncompressedSize);
+    printf("   comp=%d, csize=%llu, usize=%llu\n", cdr._compressionMethod, (unsigned long long)cdr._compressedSize, (unsigned long long)cdr._uncompressedSize);
     if(!cdr.isDir()) {      
       printf("   not dir\n");
       CDRContentReader ereader(f, cdr);
       std::vector<uint8_t> cont = ereader.readContent();
 
       printf("   uncompressedsize=%zu\n", cont.size());
-      // I assume uncompressed file must be larger than 4 bytes. because it just test!
-      printf("   %c%c%c%c...\n", cont[0], cont[1], cont[2], cont[3]);
+      // print first 4 bytes if any, test/empty.txt is empty.
+      if(cont.size() >= 4)
+        printf("   %c%c%c%c...\n", cont[0], cont[1], cont[2], cont[3]);
     }
   }
 }
 
+void testBulkCDReader(File& f) {
+  using namespace cppunzip::impl;
+
+  EOCDRReader unzipper(f);
+  EOCDRecord eocdr = unzipper.readEOCDRecord();
+
+  BulkCDReader reader(f, eocdr);
+  while(!reader.isEnd()) {
+    CDRecordView cdr = reader.readOne();
+    printf("name=%.*s, isDir=%d\n", (int)cdr._fileNameLength, cdr._fileName, cdr.isDir());
+  }
+}
 
-void printContent(std::vector<uint8_t>& content) {
+void printContent(const std::vector<uint8_t>& content) {
   for(auto i : content)
     printf("%c", (char)i);
 }
@@ -64,13 +78,315 @@ void testPublicAPI(File& f) {
   }
 }
 
+void testStreamAPI(File& f) {
+  using namespace std;
+
+  UnZipper unzipper(f);
+  for(auto& fileEntry : unzipper.listFiles()) {
+    if (fileEntry.isDir())
+      continue;
+    auto stream = fileEntry.openStream();
+    // 1 byte buffer so that inflate is left with pending output after all input is consumed (test/pending.txt).
+    vector<uint8_t> buf(1);
+    size_t total = 0;
+    size_t len;
+    while((len = stream.read(buf.data(), buf.size())) != 0)
+      total += len;
+    cout << fileEntry.fileName() << ": streamed " << total << " bytes" << endl;
+  }
+}
+
+void testMappedFile() {
+  using namespace std;
+
+  MappedFile f("test.zip");
+  UnZipper unzipper(f);
+  for(auto& fileEntry : unzipper.listFiles()) {
+    const uint8_t* view = fileEntry.contentView();
+    cout << fileEntry.fileName() << ": " << (view ? "view" : "no view") << endl;
+  }
+}
+
+void testMemoryFile() {
+  using namespace std;
+
+  ifstream is("test.zip", ios::binary);
+  vector<uint8_t> zip((istreambuf_iterator<char>(is)), istreambuf_iterator<char>());
+  MemoryFile f(zip.data(), zip.size());
+  BasicUnZipper<MemoryFile> unzipper(f);
+  for(auto& fileEntry : unzipper.listFiles()) {
+    if (fileEntry.isDir())
+      continue;
+    cout << fileEntry.fileName() << ": " << fileEntry.readContent().size() << " bytes" << endl;
+  }
+}
+
+void testBrokenStoredEntry() {
+  using namespace std;
+
+  ifstream is("test.zip", ios::binary);
+  vector<uint8_t> zip((istreambuf_iterator<char>(is)), istreambuf_iterator<char>());
+  // rewrite central directory record of test/test.txt to stored with uncompressed size 5, smaller than its 10 bytes data.
+  const string name = "test/test.txt";
+  for(size_t pos = 0; pos+46+name.size() <= zip.size(); pos++) {
+    if(zip[pos] == 0x50 && zip[pos+1] == 0x4b && zip[pos+2] == 0x01 && zip[pos+3] == 0x02
+       && zip[pos+28] == name.size() && memcmp(&zip[pos+46], name.data(), name.size()) == 0) {
+      zip[pos+10] = 0; zip[pos+11] = 0;
+      zip[pos+24] = 5; zip[pos+25] = 0; zip[pos+26] = 0; zip[pos+27] = 0;
+    }
+  }
+  MemoryFile f(zip.data(), zip.size());
+  UnZipper unzipper(f);
+  FileEntry fileEntry = unzipper.findEntry(name);
+  cout << "contentView: " << (fileEntry.contentView() ? "view" : "no view") << endl;
+  vector<uint8_t> buf(fileEntry.contentSize());
+  try {
+    fileEntry.readContentInto(buf.data(), buf.size());
+    cout << "readContentInto: not rejected" << endl;
+  } catch(UnZipError& e) {
+    cout << "readContentInto: " << e.what() << endl;
+  }
+  try {
+    fileEntry.readContent();
+    cout << "readContent: not rejected" << endl;
+  } catch(UnZipError& e) {
+    cout << "readContent: " << e.what() << endl;
+  }
+}
+
+void testBasicUnZipper() {
+  using namespace std;
+
+  MappedFile f("test.zip");
+  BasicUnZipper<MappedFile> unzipper(f);
+  BasicUnZipper<MappedFile>::FileEntry fileEntry = unzipper.findEntry("test/test.txt");
+  printContent(fileEntry.readContent());
+}
+
+void testCachedFile(File& f) {
+  using namespace std;
+
+  CachedFile cached(f, 4096, 16);
+  UnZipper unzipper(cached);
+  for(auto& fileEntry : unzipper.listFiles()) {
+    if (fileEntry.isDir())
+      continue;
+    cout << fileEntry.fileName() << ": " << fileEntry.readContent().size() << " bytes" << endl;
+  }
+  cout << "cached blocks: " << cached._blocks.size() << endl;
+}
+
+void testIndex(File& f) {
+  using namespace std;
+
+  UnZipper unzipper(f);
+  unzipper.buildIndex();
+  cout << "index of test/test.txt: " << unzipper.indexOf("test/test.txt") << endl;
+  cout << "index of notexist.txt: " << unzipper.indexOf("notexist.txt") << endl;
+
+  auto content = unzipper.findEntry("test/testdir/test4.txt").readContent();
+  printContent(content);
+  cout << endl;
+}
+
+void testExtractAll(File& f) {
+  using namespace std;
+
+  UnZipper unzipper(f);
+  std::mutex m;
+  unzipper.extractAll([&m](FileEntry& fileEntry, vector<uint8_t>& content) {
+    std::lock_guard<std::mutex> lock(m);
+    cout << fileEntry.fileName() << ": " << content.size() << " bytes" << endl;
+  }, 2);
+}
+
+void testSubmitRead(File& f) {
+  using namespace std;
+
+  vector<uint8_t> head(4), tail(22);
+  ReadRequest reqs[] = { ReadRequest(0, head.data(), head.size()), ReadRequest(f._size-tail.size(), tail.data(), tail.size()) };
+  ReadRequest* ptrs[] = { &reqs[0], &reqs[1] };
+  f.submitRead(ptrs, 2);
+  size_t tailLen = f.waitRead(reqs[1]);
+  size_t headLen = f.waitRead(reqs[0]);
+  printf("head %zu bytes: %02x %02x, tail %zu bytes: %02x %02x\n", headLen, head[0], head[1], tailLen, tail[0], tail[1]);
+}
+
+// define CPPUNZIP_ENABLE_STATS to see non zero result.
+void testStats(File& f) {
+  UnZipper unzipper(f);
+  UnZipStats stats;
+  unzipper.setStatsObserver(&stats);
+  unzipper.buildIndex();
+  for(auto& fileEntry : unzipper.listFiles()) {
+    if (!fileEntry.isDir())
+      fileEntry.readContent();
+  }
+  unzipper.setStatsObserver(nullptr);
+  printf("reads=%llu, bytes=%llu, inflated=%llu bytes in %llu ns, ratio=%.3f\n", (unsigned long long)stats._readCalls,
+    (unsigned long long)stats._readBytes, (unsigned long long)stats._inflateOutBytes, (unsigned long long)stats._inflateNanos,
+    stats.compressionRatio());
+}
+
+void testReadContentInto(File& f) {
+  using namespace std;
+
+  UnZipper unzipper(f);
+  ReusableScratch scratch;
+  vector<uint8_t> buf;
+  for(auto& fileEntry : unzipper.listFiles()) {
+    if (fileEntry.isDir())
+      continue;
+    if (buf.size() < fileEntry.contentSize())
+      buf.resize(fileEntry.contentSize());
+    size_t len = fileEntry.readContentInto(buf.data(), buf.size(), scratch);
+    cout << fileEntry.fileName() << ": " << len << " bytes" << endl;
+  }
+}
+
+void testReadRange(File& f) {
+  using namespace std;
+
+  UnZipper unzipper(f);
+  FileEntry fileEntry = unzipper.findEntry("test/test2.txt");
+  auto index = fileEntry.buildSeekIndex();
+  auto serialized = index.serialize();
+  auto restored = impl::SeekIndex::Deserialize(serialized.data(), serialized.size());
+
+  auto content = fileEntry.readRange(6, 5, restored);
+  cout << "range: [";
+  printContent(content);
+  cout << "]" << endl;
+}
+
+void testReadEntries(File& f) {
+  using namespace std;
+
+  UnZipper unzipper(f);
+  vector<size_t> selected;
+  for(size_t i = 0; i < unzipper.index().size(); i++)
+    selected.push_back(i);
+  unzipper.readEntries(selected, [](FileEntry& entry, vector<uint8_t>& content) {
+    cout << entry.fileName() << ": " << content.size() << " bytes" << endl;
+  });
+}
+
+void testContentCache(File& f) {
+  using namespace std;
+
+  ContentCache cache(1024*1024);
+  UnZipper unzipper(f);
+  unzipper.setContentCache(&cache);
+  SharedContent first = unzipper.readSharedContent("test/test.txt");
+  SharedContent second = unzipper.readSharedContent("test/test.txt");
+  cout << "shared: " << (first == second) << ", cache size: " << cache.bytes() << endl;
+  printContent(*second);
+  cout << endl;
+
+  // 282 bytes content is larger than budget/shardNum, but budget is for all shards.
+  ContentCache small(300);
+  unzipper.setContentCache(&small);
+  unzipper.readSharedContent("test/pending.txt");
+  unzipper.readSharedContent("test/test.txt");
+  cout << "small cache size: " << small.bytes() << endl;
+}
+
+void testForEachEntry(File& f) {
+  using namespace std;
+
+  UnZipper unzipper(f);
+  size_t num = unzipper.forEachEntry("test/testdir/", [](FileEntry& fileEntry) {
+    cout << fileEntry.fileName() << endl;
+    return true;
+  }, 64);
+  cout << "matched: " << num << endl;
+}
+
+void testListDirectory(File& f) {
+  using namespace std;
+
+  UnZipper unzipper(f);
+  for(auto& ent : unzipper.listDirectory("test/"))
+    cout << ent._path << (ent._isDir ? " (dir)" : "") << endl;
+  for(auto& ent : unzipper.glob("test/*/*.txt"))
+    cout << "glob: " << ent._path << endl;
+}
+
+void testDecoderRegistry(File& f) {
+  using namespace std;
+
+  UnZipper unzipper(f);
+  for(auto& fileEntry : unzipper.listFiles()) {
+    uint16_t method = fileEntry._entry._compressionMethod;
+    cout << fileEntry.fileName() << ": method " << method << (impl::DecoderRegistry::Default().supports(method) ? " supported" : " unsupported") << endl;
+  }
+}
+
+void testReadContentParallel(File& f) {
+  using namespace std;
+
+  UnZipper unzipper(f);
+  FileEntry fileEntry = unzipper.findEntry("test/test.txt");
+  auto index = fileEntry.buildSeekIndex(16);
+  auto content = fileEntry.readContentParallel(index, 4);
+  printContent(content);
+}
+
+void testIndexCache(File& f) {
+  using namespace std;
+
+  vector<uint8_t> cache;
+  {
+    UnZipper unzipper(f);
+    // use mtime of archive or something for stamp in real use.
+    cache = unzipper.saveIndexCache(1);
+  }
+  UnZipper unzipper(f, cache.data(), cache.size(), 1);
+  cout << "from cache: " << unzipper.isIndexFromCache() << ", cache size: " << cache.size() << endl;
+  auto content = unzipper.findEntry("test/test.txt").readContent();
+  printContent(content);
+  cout << endl;
+}
+
+void testStreamUnZipper() {
+  using namespace std;
+
+  ifstream is("test.zip", std::ios::binary);
+  StreamUnZipper unzipper(is);
+  while(unzipper.next()) {
+    auto content = unzipper.readContent();
+    cout << unzipper.fileName() << ": " << content.size() << " bytes" << endl;
+  }
+}
+
 int main() {
   std::ifstream is("test.zip", std::ios::binary);
   IStreamFile f(is);
 
   // testIStreamFile(f);
   // testInternalAPI(f);
+  // testBulkCDReader(f);
   testPublicAPI(f);
+  // testStreamAPI(f);
+  // testMappedFile();
+  // testBasicUnZipper();
+  // testMemoryFile();
+  // testBrokenStoredEntry();
+  // testStreamUnZipper();
+  // testCachedFile(f);
+  // testIndex(f);
+  // testExtractAll(f);
+  // testSubmitRead(f);
+  // testStats(f);
+  // testReadContentInto(f);
+  // testReadRange(f);
+  // testReadContentParallel(f);
+  // testReadEntries(f);
+  // testContentCache(f);
+  // testDecoderRegistry(f);
+  // testForEachEntry(f);
+  // testListDirectory(f);
+  // testIndexCache(f);
 
   return 0;
 }
\ No newline at end of file